@@ -127,7 +127,19 @@ void example_eventbus_in_qml()
     // 在 QML 中订阅事件
     // =========================================================================
     //
-    // 方式1：使用 Connections 监听 eventPublished 信号
+    // 方式1（推荐）：EventSubscription 元素，只接收匹配 pattern 的事件
+    //
+    // import MPF.Events 1.0
+    //
+    // EventSubscription {
+    //     pattern: "orders/*"
+    //     subscriberId: "com.biiz.rules"
+    //     onReceived: (topic, data, senderId) => {
+    //         console.log("收到订单事件:", topic, JSON.stringify(data))
+    //     }
+    // }
+    //
+    // 方式2：使用 Connections 监听 eventPublished 信号
     //
     // Connections {
     //     target: EventBus
@@ -139,7 +151,7 @@ void example_eventbus_in_qml()
     //     }
     // }
     //
-    // 方式2：先 subscribe 再监听（带过滤）
+    // 方式3：先 subscribe 再监听（带过滤）
     //
     // Component.onCompleted: {
     //     EventBus.subscribeSimple("orders/*", "com.biiz.rules")
@@ -151,7 +163,8 @@ void example_eventbus_in_qml()
     //
     // 【注意】
     // QML 层的 Connections 会接收所有事件，需要在 onEventPublished 中
-    // 手动过滤 topic。subscribe 的作用是注册订阅关系（影响 subscriberCount
+    // 手动过滤 topic，每个事件都要转换成 JS 对象；EventSubscription 通过
+    // topic 索引只投递匹配的事件。eventPublished 只在有连接时才发出。subscribe 的作用是注册订阅关系（影响 subscriberCount
     // 和 notified 返回值），但实际事件投递是通过 Qt 信号机制。
 }
 
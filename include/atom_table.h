@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace mpf {
+
+/**
+ * @brief Append-only table interning strings as small integer ids
+ *
+ * intern() takes a lock and hashes the string once; at() is a lock-free
+ * array lookup, which is what keeps id-based hot paths free of hashing.
+ * Ids start at 1 (0 means "none") and stay valid for the lifetime of the
+ * table: entries are never removed, so only intern bounded sets of names.
+ *
+ * Each entry carries an optional default-constructed Payload that callers
+ * may update concurrently (e.g. atomic counters).
+ */
+template <typename Payload = std::nullptr_t>
+class AtomTable
+{
+public:
+    struct Entry {
+        QString name;
+        Payload payload{};
+    };
+
+    AtomTable() = default;
+    ~AtomTable()
+    {
+        for (std::atomic<Entry*>& segment : m_segments) {
+            delete[] segment.load(std::memory_order_relaxed);
+        }
+    }
+
+    AtomTable(const AtomTable&) = delete;
+    AtomTable& operator=(const AtomTable&) = delete;
+
+    /**
+     * @brief Id of @p name, registering it on first use (0 if the table is full)
+     */
+    quint32 intern(const QString& name)
+    {
+        return intern(name, [](Payload&) {});
+    }
+
+    /**
+     * @brief As intern(), calling @p init on the new entry's payload before it becomes visible
+     */
+    template <typename Init>
+    quint32 intern(const QString& name, Init&& init)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const quint32 existing = m_ids.value(name, 0);
+        if (existing != 0) {
+            return existing;
+        }
+
+        const quint32 index = m_count.load(std::memory_order_relaxed);
+        if (index >= kSegmentSize * kMaxSegments) {
+            return 0;
+        }
+
+        std::atomic<Entry*>& segment = m_segments[index >> kSegmentBits];
+        Entry* entries = segment.load(std::memory_order_relaxed);
+        if (!entries) {
+            entries = new Entry[kSegmentSize];
+            segment.store(entries, std::memory_order_release);
+        }
+        Entry& entry = entries[index & kSegmentMask];
+        entry.name = name;
+        init(entry.payload);
+
+        // Publishing the count makes the entry visible to at()
+        m_ids.insert(name, index + 1);
+        m_count.store(index + 1, std::memory_order_release);
+        return index + 1;
+    }
+
+    /**
+     * @brief Id of an already interned @p name, 0 if unknown
+     */
+    quint32 find(const QString& name) const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_ids.value(name, 0);
+    }
+
+    /**
+     * @brief Entry for @p id without locking, nullptr if unknown
+     */
+    Entry* at(quint32 id) const
+    {
+        if (id == 0 || id > m_count.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        const quint32 index = id - 1;
+        return &m_segments[index >> kSegmentBits].load(std::memory_order_acquire)[index & kSegmentMask];
+    }
+
+    int size() const { return int(m_count.load(std::memory_order_acquire)); }
+
+private:
+    static constexpr quint32 kSegmentBits = 10;
+    static constexpr quint32 kSegmentSize = 1u << kSegmentBits;
+    static constexpr quint32 kSegmentMask = kSegmentSize - 1;
+    static constexpr quint32 kMaxSegments = 1024;
+
+    mutable QMutex m_mutex;                             // guards m_ids and interning
+    QHash<QString, quint32> m_ids;
+    std::array<std::atomic<Entry*>, kMaxSegments> m_segments{};
+    std::atomic<quint32> m_count{0};
+};
+
+} // namespace mpf
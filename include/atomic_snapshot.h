@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace mpf {
+
+/**
+ * @brief shared_ptr slot that readers load while writers replace it
+ *
+ * Uses std::atomic<std::shared_ptr> where the standard library has it
+ * (C++20), else the std::atomic_load/atomic_store overloads, which C++20
+ * deprecates. Neither is lock-free in libstdc++ or MSVC: the C++20 type
+ * spins on a lock bit in the slot itself, and the older overloads lock a
+ * mutex from a small global pool keyed by the slot's address. The lock is
+ * held only to copy the pointer and bump its reference count, never while
+ * a writer builds the next value, so readers wait at most for that copy.
+ */
+template <typename T>
+class AtomicSnapshot
+{
+public:
+    AtomicSnapshot() = default;
+    explicit AtomicSnapshot(std::shared_ptr<T> value) : m_value(std::move(value)) {}
+
+    AtomicSnapshot(const AtomicSnapshot&) = delete;
+    AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+    std::shared_ptr<T> load() const
+    {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        return m_value.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&m_value, std::memory_order_acquire);
+#endif
+    }
+
+    void store(std::shared_ptr<T> value)
+    {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        m_value.store(std::move(value), std::memory_order_release);
+#else
+        std::atomic_store_explicit(&m_value, std::move(value), std::memory_order_release);
+#endif
+    }
+
+private:
+#if defined(__cpp_lib_atomic_shared_ptr)
+    std::atomic<std::shared_ptr<T>> m_value;
+#else
+    std::shared_ptr<T> m_value;
+#endif
+};
+
+} // namespace mpf
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "shared_payload.h"
+
 #include <QString>
 #include <QStringList>
 #include <QVariant>
@@ -100,10 +102,34 @@ inline QVariant deepCopy(const QVariant& var)
     case QMetaType::QVariantList:
         return QVariant(deepCopy(var.toList()));
     default:
+        if (var.metaType() == QMetaType::fromType<SharedPayload>()) {
+            return SharedPayload::fromVariant(var).adopted().toVariant();
+        }
         // For primitive types (int, double, bool, etc.), QVariant copy is safe
         return var;
     }
 }
 
+/**
+ * @brief Copy the SharedPayload values of @p data into this module's buffers
+ *
+ * Unlike deepCopy() it leaves everything else shared, so it is cheap enough
+ * for every publish: without payloads it allocates nothing.
+ */
+inline QVariantMap adoptPayloads(const QVariantMap& data)
+{
+    QVariantMap result = data;
+    for (auto it = data.constBegin(); it != data.constEnd(); ++it) {
+        if (it->metaType() == QMetaType::fromType<SharedPayload>()) {
+            const SharedPayload payload = SharedPayload::fromVariant(*it);
+            const SharedPayload adopted = payload.adopted();
+            if (adopted != payload) {
+                result.insert(it.key(), adopted.toVariant());
+            }
+        }
+    }
+    return result;
+}
+
 } // namespace CrossDllSafety
 } // namespace mpf
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <mpf/interfaces/ieventbus.h>
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+
+#include <atomic>
+#include <memory>
+
+class QLocalServer;
+class QLocalSocket;
+
+namespace mpf {
+
+class EventBusService;
+
+/**
+ * @brief Forwards events between EventBusServices in different processes on one machine
+ *
+ * Each bridge has a name; other bridges connect to it by that name. Every
+ * connection has a Unix domain socket (a named pipe on Windows) for control
+ * messages and, per direction, a shared-memory ring owned by the sending
+ * side for the events themselves.
+ *
+ * Local events matching a forward() pattern are collected from the
+ * publishing thread and sent on the bridge's thread in batches: a burst of
+ * publishes becomes one frame per peer and one wake-up message on the
+ * socket. Frames use a compact binary encoding in which each topic and
+ * sender string is sent once per connection and then referred to by a
+ * 16 bit id; payloads are CBOR.
+ *
+ * Received events are published into the local bus with their original
+ * topic, sender and timestamp, and are not forwarded again, so events
+ * travel exactly one hop. When a peer's ring is full, events wait in a
+ * bounded backlog until the peer catches up; beyond that they are dropped
+ * and counted.
+ */
+class EventBusBridge : public QObject
+{
+    Q_OBJECT
+
+public:
+    EventBusBridge(EventBusService* bus, const QString& name, QObject* parent = nullptr);
+    ~EventBusBridge() override;
+
+    QString name() const { return m_name; }
+
+    /**
+     * @brief Accept connections from other bridges under name()
+     */
+    bool listen();
+
+    /**
+     * @brief Connect to the bridge listening as @p peerName
+     */
+    void connectToPeer(const QString& peerName);
+
+    /**
+     * @brief Send local events on topics matching @p pattern to every peer
+     */
+    void forward(const QString& pattern);
+    bool stopForwarding(const QString& pattern);
+
+    /**
+     * @brief Size of each outbound shared-memory ring (rounded up to a power of two)
+     *
+     * Applies to connections made afterwards. Sizes above 1 GiB are
+     * rejected with false and leave the capacity unchanged.
+     */
+    bool setRingCapacity(qsizetype bytes);
+
+    QStringList peers() const;
+
+    /**
+     * @brief {sent, received, dropped, unencodable, frames, peers}
+     *
+     * unencodable counts payload values CBOR cannot carry, which the peer
+     * receives as undefined.
+     */
+    QVariantMap stats() const;
+
+signals:
+    void peerConnected(const QString& peerName);
+    void peerDisconnected(const QString& peerName);
+
+private:
+    class Ring;
+    struct Peer;
+
+    void addPeer(QLocalSocket* socket);
+    void removePeer(Peer* peer);
+    void readControl(Peer* peer);
+    void sendControl(Peer* peer, quint8 type, const QByteArray& payload = {});
+    void attachInbound(Peer* peer, const QByteArray& payload);
+
+    void collect(const Event& event);
+    void flush();
+    void flushPeer(Peer* peer);
+    void drain(Peer* peer);
+    void dropped(qint64 count);
+
+    QPointer<EventBusService> m_bus;
+    const QString m_name;
+    QLocalServer* m_server = nullptr;
+    qsizetype m_ringCapacity = 4 * 1024 * 1024;     // power of two
+    QHash<QString, QString> m_forwards;                 // pattern -> subscription id
+    QList<Peer*> m_peers;
+
+    // Filled on publishing threads, drained by flush() on the bridge's thread
+    QMutex m_outboxLock;
+    QList<Event> m_outbox;
+
+    qint64 m_sent = 0;
+    qint64 m_received = 0;
+    qint64 m_frames = 0;
+    qint64 m_unencodable = 0;
+    std::atomic<qint64> m_dropped{0};
+    std::atomic<bool> m_warnedDrop{false};
+};
+
+} // namespace mpf
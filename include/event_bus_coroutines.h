@@ -0,0 +1,137 @@
+#pragma once
+
+/**
+ * @file event_bus_coroutines.h
+ * @brief co_await support for EventBusService futures (C++20 translation units only)
+ *
+ * The host itself builds as C++17; this header is empty there (the event
+ * bus tests build as C++20 to cover it). Code built with coroutine support
+ * can write request -> wait -> react flows without callbacks or blocking:
+ *
+ *   mpf::EventTask syncOrder(mpf::EventBusService* bus, QString id)
+ *   {
+ *       const auto order = co_await bus->requestAsync("orders/get", {{"id", id}}, "sync", 500);
+ *       if (!order) {
+ *           co_return;                      // no handler, or timed out
+ *       }
+ *       const auto shipped = co_await bus->nextEvent("orders/" + id + "/shipped", 60000);
+ *       ...
+ *   }
+ *
+ * co_await on a QFuture<T> yields std::optional<T>: the first result, or
+ * nullopt if the future was canceled. The coroutine always resumes on the
+ * thread that awaited, from that thread's event loop, so it needs one (the
+ * GUI thread or a QThread running exec()). Nothing blocks and no threads
+ * are added.
+ *
+ * Host-only: requestAsync() and nextEvent() are EventBusService members,
+ * not part of the SDK's IEventBus, so plugins cannot reach them. The
+ * awaiter itself works on any QFuture.
+ */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define MPF_HAS_COROUTINES 1
+
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QDebug>
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace mpf {
+
+/**
+ * @brief Awaiter resuming the coroutine from the awaiting thread's event loop
+ */
+template <typename T>
+class FutureAwaiter
+{
+public:
+    explicit FutureAwaiter(QFuture<T> future) : m_future(std::move(future)) {}
+
+    // Destroyed while suspended, with the coroutine frame holding it: nothing
+    // may resume that frame any more, and the producer is told to give up
+    // (nextEvent() then drops its subscription)
+    ~FutureAwaiter()
+    {
+        if (m_watcher) {
+            QObject::disconnect(m_watcher, nullptr, nullptr, nullptr);
+            m_watcher->deleteLater();
+            m_future.cancel();
+        }
+    }
+
+    FutureAwaiter(const FutureAwaiter&) = delete;
+    FutureAwaiter& operator=(const FutureAwaiter&) = delete;
+
+    bool await_ready() const { return m_future.isFinished(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // The watcher lives in the current thread, so finished() (emitted for
+        // canceled futures too) is delivered through this thread's event loop
+        m_watcher = new QFutureWatcher<T>();
+        QObject::connect(m_watcher, &QFutureWatcherBase::finished, m_watcher, [this, handle]() {
+            std::exchange(m_watcher, nullptr)->deleteLater();
+            handle.resume();        // May destroy this awaiter
+        });
+        m_watcher->setFuture(m_future);
+    }
+
+    std::optional<T> await_resume() const
+    {
+        if (m_future.isCanceled() || m_future.resultCount() == 0) {
+            return std::nullopt;
+        }
+        return m_future.result();
+    }
+
+private:
+    QFuture<T> m_future;
+    QFutureWatcher<T>* m_watcher = nullptr;     // set while suspended
+};
+
+/**
+ * @brief Fire-and-forget coroutine type for event flows
+ *
+ * Starts running immediately and frees itself when it finishes. An
+ * exception escaping the coroutine is logged, not rethrown.
+ */
+class EventTask
+{
+public:
+    struct promise_type {
+        EventTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            try {
+                std::rethrow_exception(std::current_exception());
+            } catch (const std::exception& e) {
+                qWarning() << "EventBus: Coroutine threw exception:" << e.what();
+            } catch (...) {
+                qWarning() << "EventBus: Coroutine threw unknown exception";
+            }
+        }
+    };
+};
+
+} // namespace mpf
+
+/**
+ * @brief Makes any QFuture (requestAsync, nextEvent, gather, ...) awaitable
+ */
+template <typename T>
+mpf::FutureAwaiter<T> operator co_await(QFuture<T> future)
+{
+    return mpf::FutureAwaiter<T>(std::move(future));
+}
+
+#endif
@@ -2,28 +2,172 @@
 
 #include <mpf/interfaces/ieventbus.h>
 
+#include "atom_table.h"
+#include "atomic_snapshot.h"
+#include "event_metrics.h"
+#include "payload_filter.h"
+#include "shared_payload.h"
+#include "timer_wheel.h"
+#include "topic_trie.h"
+
 #include <QObject>
+#include <QDeadlineTimer>
+#include <QFuture>
 #include <QHash>
+#include <QMap>
 #include <QMutex>
-#include <QRegularExpression>
+#include <QPromise>
+#include <QQueue>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QWaitCondition>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <vector>
 
 namespace mpf {
 
+class EventJournal;
+
 // Callback types for C++ event handling (not part of SDK interface)
 using EventHandler = std::function<void(const Event&)>;
 using RequestHandler = std::function<QVariantMap(const Event&)>;
 
+// Interned topic / sender (plugin) ids, see EventBusService::registerTopic; 0 means none
+using TopicId = quint32;
+using SenderId = quint32;
+
+/**
+ * @brief Where an async subscription's handler runs
+ *
+ * Every target delivers a given subscription's events in publish order,
+ * publishSync() included: it queues behind the subscription's pending
+ * events and waits until the handler ran on its own thread.
+ */
+enum class DeliveryTarget {
+    OwnerThread,    ///< Thread owning the EventBusService (the GUI thread); default
+    CallerThread,   ///< Inline on the publishing thread, before publish() returns
+    WorkerThread,   ///< Named worker QThread managed by the bus
+    Pool            ///< Shared thread pool, serialized per subscription
+};
+
+/**
+ * @brief What an async subscription does when its mailbox is full
+ */
+enum class OverflowPolicy {
+    DropOldest,     ///< Discard the oldest pending event; default
+    DropNewest,     ///< Discard the event being published
+    CoalesceByKey,  ///< Replace a pending event with the same coalesceKey value, else drop oldest
+    Block           ///< Make the publisher wait for room (never on the consuming thread)
+};
+
+/**
+ * @brief Host-side subscription options (superset of the SDK's SubscriptionOptions)
+ */
+struct ExtendedSubscriptionOptions : SubscriptionOptions
+{
+    DeliveryTarget target = DeliveryTarget::OwnerThread;
+    QString workerThread;   ///< Thread name for DeliveryTarget::WorkerThread
+
+    int queueCapacity = 1024;                           ///< Pending async events; <= 0 is unbounded
+    OverflowPolicy overflow = OverflowPolicy::DropOldest;
+    QString coalesceKey;    ///< Payload field compared by OverflowPolicy::CoalesceByKey
+
+    /// Latest value wins: a pending event of the same topic (and, if
+    /// conflationKey is set, the same value of that payload field) is
+    /// replaced instead of queuing another one
+    bool conflate = false;
+    QString conflationKey;
+
+    /// Retained events (see EventBusService::setTopicRetention) to deliver
+    /// per matching topic right after subscribing; -1 for all of them
+    int replay = 0;
+
+    /// Only events whose payload matches are delivered (or counted as
+    /// notified); checked before queuing, see PayloadFilter
+    PayloadFilter filter;
+
+    /// Throttle: at most one event per throttleMs, across all topics of the
+    /// subscription. throttleLeading delivers the first event of a quiet
+    /// period at once, throttleTrailing the last one of a window when it ends
+    int throttleMs = 0;
+    bool throttleLeading = true;
+    bool throttleTrailing = true;
+
+    /// Debounce: only the last event of a burst, once debounceMs passed
+    /// without another one; takes precedence over throttleMs
+    int debounceMs = 0;
+
+    /// false exempts the handler from the SlowHandlerPolicy: it is never
+    /// counted as a violation nor demoted, for handlers that must stay on
+    /// their delivery thread
+    bool watchdog = true;
+};
+
+/**
+ * @brief Host-side request handler options
+ *
+ * The target is the handler's executor. CallerThread (the default) keeps
+ * the SDK behaviour of running the handler inside request(). request()
+ * from the executor itself (or from any pool thread, for Pool) also runs
+ * the handler inline, since waiting there could deadlock; otherwise it
+ * waits at most 30 s when given no timeout.
+ */
+struct RequestHandlerOptions
+{
+    DeliveryTarget target = DeliveryTarget::CallerThread;
+    QString workerThread;   ///< Thread name for DeliveryTarget::WorkerThread
+};
+
+/**
+ * @brief When EventBusService::gather() reports its replies
+ */
+struct GatherOptions
+{
+    int timeoutMs = 0;      ///< Deadline; 0 waits for every handler
+    int quorum = 0;         ///< Replies to wait for; 0 (or more than there are handlers) means all
+};
+
+/**
+ * @brief Time budget for subscription handlers, see EventBusService::setSlowHandlerPolicy
+ */
+struct SlowHandlerPolicy
+{
+    int budgetMs = 16;      ///< A handler call taking longer is a violation; 0 disables the watchdog
+    int demoteAfter = 0;    ///< Violations before a handler is moved off-thread; 0 only reports
+    QString workerThread = QStringLiteral("demoted");  ///< Thread name demoted handlers run on
+};
+
+/**
+ * @brief Position of the event being handled in its topic's sequence
+ *
+ * See EventBusService::setTopicSequencing() and currentSequence().
+ */
+struct EventSequence
+{
+    quint64 sequence = 0;   ///< Per-topic number starting at 1; 0 if the topic is not sequenced
+    quint64 missed = 0;     ///< Events of the topic this subscription did not get since its previous one
+};
+
 /**
  * @brief Default event bus service implementation
  *
  * Provides publish/subscribe messaging with:
- * - Wildcard topic matching (* and **)
- * - Priority-based delivery ordering
+ * - Wildcard topic matching (* and **) via a segment trie
+ * - Priority-based delivery ordering, also across queued events
  * - Async and sync event delivery
  * - Thread-safe operations
+ *
+ * Subscriptions live in an immutable snapshot that writers replace as a
+ * whole; publishers only load the current snapshot, so publishing never
+ * waits for a subscribe/unsubscribe to finish. Loading it is a short
+ * critical section, not lock-free (see AtomicSnapshot).
  */
 class EventBusService : public QObject, public IEventBus
 {
@@ -40,16 +184,61 @@ public:
                             const QVariantMap& data,
                             const QString& senderId = {}) override;
 
+    /**
+     * @brief Publish and return once every handler has run
+     *
+     * CallerThread handlers run inline. Every other handler still runs on
+     * its own target, in order behind the events already queued for it,
+     * while this call waits: on that target's own thread (or from a handler
+     * of the same subscription) the queue is drained right here, otherwise
+     * the wait is capped at 5 s so two threads publishing synchronously to
+     * each other's subscribers cannot deadlock; an event not handled by
+     * then is still delivered later. Throttled, debounced and conflated
+     * subscriptions go through their gate or slot like publish() and are
+     * not waited for.
+     */
     Q_INVOKABLE int publishSync(const QString& topic,
                                 const QVariantMap& data,
                                 const QString& senderId = {}) override;
 
+    /**
+     * @brief Publish many events asynchronously in one go
+     *
+     * Subscribers are resolved once per distinct topic, and each subscriber's
+     * mailbox is locked and scheduled once for its whole slice of the batch.
+     * Every subscriber sees the events in batch order. Events with a zero
+     * timestamp are stamped with the current time.
+     *
+     * @return Number of subscriber notifications, summed over the batch
+     */
+    int publishBatch(const QList<Event>& events);
+
+    /**
+     * @brief Allocation-free publishing through interned ids
+     *
+     * Ids come from registerTopic()/registerSender() and stay valid for the
+     * lifetime of the bus. Only register bounded sets of names (not topics
+     * that embed record IDs): interned names are never released.
+     */
+    TopicId registerTopic(const QString& topic);
+    SenderId registerSender(const QString& senderId);
+    QString topicName(TopicId topic) const;
+
+    int publish(TopicId topic, const QVariantMap& data, SenderId sender = 0);
+    int publishSync(TopicId topic, const QVariantMap& data, SenderId sender = 0);
+
     // IEventBus interface - Subscribing (with callback)
     QString subscribe(const QString& pattern,
                       const QString& subscriberId,
                       EventHandler handler,
                       const SubscriptionOptions& options = {}) override;
 
+    // Host extension - subscribe with delivery target etc.
+    QString subscribe(const QString& pattern,
+                      const QString& subscriberId,
+                      EventHandler handler,
+                      const ExtendedSubscriptionOptions& options);
+
     // Convenience overload without callback (uses signal-based delivery)
     QString subscribe(const QString& pattern,
                       const QString& subscriberId,
@@ -70,6 +259,66 @@ public:
                                        int timeoutMs = 0) override;
     bool hasHandler(const QString& topic) const override;
 
+    // Host extension - request handlers with an executor
+    bool registerHandler(const QString& topic,
+                         const QString& handlerId,
+                         RequestHandler handler,
+                         const RequestHandlerOptions& options);
+
+    /**
+     * @brief Send a request without blocking the caller
+     *
+     * The handler runs on its executor (CallerThread handlers run on the
+     * delivery pool). The future gets the reply as its single result, or
+     * finishes canceled if there is no handler, the handler throws, or no
+     * reply arrived within @p timeoutMs (0 = no deadline). Canceling the
+     * future skips the handler if it hasn't started yet; a running handler
+     * is not interrupted, its reply is just discarded.
+     */
+    QFuture<QVariantMap> requestAsync(const QString& topic,
+                                      const QVariantMap& data = {},
+                                      const QString& senderId = {},
+                                      int timeoutMs = 0);
+
+    /**
+     * @brief Wait for the next event on a topic matching @p pattern without blocking
+     *
+     * The future gets that event as its single result, or finishes canceled
+     * if none was published within @p timeoutMs (0 = no deadline) or the
+     * caller canceled it. Events of any sender count, including
+     * @p subscriberId's own. The temporary subscription is removed when the
+     * future settles and is internal: it emits none of the subscription
+     * signals. Without a deadline only an event or cancel() ends the wait,
+     * so cancel a future you stop caring about instead of just dropping it.
+     * See event_bus_coroutines.h for co_await support.
+     */
+    QFuture<Event> nextEvent(const QString& pattern, int timeoutMs = 0,
+                             const QString& subscriberId = {});
+
+    /**
+     * @brief Scatter-gather: any number of plugins can answer a gather topic
+     *
+     * Gather handlers are separate from the single handler per topic used by
+     * request(); unregisterAllHandlers() removes both kinds.
+     */
+    bool registerGatherHandler(const QString& topic,
+                               const QString& handlerId,
+                               RequestHandler handler,
+                               const RequestHandlerOptions& options = {});
+    bool unregisterGatherHandler(const QString& topic, const QString& handlerId);
+
+    /**
+     * @brief Fan a request out to every gather handler of @p topic in parallel
+     *
+     * The future's single result maps handlerId -> reply. It is reported once
+     * all handlers answered, the quorum is reached or the deadline expires,
+     * whichever comes first; handlers that fail or answer late are left out.
+     */
+    QFuture<QVariantMap> gather(const QString& topic,
+                                const QVariantMap& data = {},
+                                const QString& senderId = {},
+                                const GatherOptions& options = {});
+
     // IEventBus interface - Query
     Q_INVOKABLE int subscriberCount(const QString& topic) const override;
     Q_INVOKABLE QStringList activeTopics() const override;
@@ -81,12 +330,127 @@ public:
     Q_INVOKABLE QString subscribeSimple(const QString& pattern, const QString& subscriberId);
     Q_INVOKABLE QVariantMap topicStatsAsVariant(const QString& topic) const;
 
+    /**
+     * @brief Per-topic delivery cache counters
+     * @return {hits, misses, entries, generation}
+     */
+    Q_INVOKABLE QVariantMap deliveryCacheStats() const;
+
+    /**
+     * @brief Mailbox counters of one subscription
+     * @return {id, pattern, subscriberId, queueDepth, highWater, capacity, delivered, dropped,
+     *          conflated, suppressed, violations, handlerTimeUs}; empty if the subscription
+     *          does not exist
+     */
+    Q_INVOKABLE QVariantMap subscriptionStats(const QString& subscriptionId) const;
+
+    /**
+     * @brief Metrics of every tracked topic and every subscription in one call
+     *
+     * Returns {"topics": [...], "subscriptions": [...]}. Topic entries carry
+     * eventCount, lastEventTime, rates (events/s over 1s/10s/60s) and the
+     * deliveryLatencyUs / handlerTimeUs histograms; subscription entries carry
+     * their own handlerTimeUs. Histograms report count, mean, max and
+     * p50/p90/p99/p999 in microseconds.
+     */
+    Q_INVOKABLE QVariantMap metricsSnapshot() const;
+
+    /**
+     * @brief Watch handler run times and optionally demote repeat offenders
+     *
+     * Every handler call is timed; calls over budgetMs are counted per
+     * subscription and reported by slowHandlers(). Once a subscription has
+     * demoteAfter violations it is moved to the policy's worker thread:
+     * CallerThread and OwnerThread handlers stop running on the publisher
+     * or GUI thread, and publishSync() queues to it instead of waiting.
+     * Events already queued move along in order. Demotion lasts for the
+     * lifetime of the subscription.
+     */
+    void setSlowHandlerPolicy(const SlowHandlerPolicy& policy);
+    SlowHandlerPolicy slowHandlerPolicy() const;
+
+    /**
+     * @brief Subscriptions that went over the handler budget, most violations first
+     * @return [{id, pattern, subscriberId, violations, worstUs, lastTopic, demoted, handlerTimeUs}]
+     */
+    Q_INVOKABLE QVariantList slowHandlers() const;
+
+    /**
+     * @brief Conflate every async subscriber of topics matching @p pattern
+     *
+     * Same as ExtendedSubscriptionOptions::conflate, applied to all
+     * subscriptions (including eventPublished) for those topics.
+     * @param payloadKey Optional payload field that distinguishes values within a topic
+     */
+    Q_INVOKABLE void setTopicConflation(const QString& pattern, const QString& payloadKey = {});
+    Q_INVOKABLE bool clearTopicConflation(const QString& pattern);
+
+    /**
+     * @brief Keep the last @p depth events of every topic matching @p pattern
+     *
+     * depth 1 makes a sticky topic holding its current value; larger depths
+     * give a replay ring. Subscriptions with ExtendedSubscriptionOptions::replay
+     * get the retained events before any live one. At most 4096 topics are
+     * retained in total, so use patterns whose topics form a bounded set.
+     */
+    Q_INVOKABLE void setTopicRetention(const QString& pattern, int depth = 1);
+    Q_INVOKABLE bool clearTopicRetention(const QString& pattern);
+
+    /**
+     * @brief Payload of the newest retained event of @p topic, empty if none
+     */
+    Q_INVOKABLE QVariantMap retainedValue(const QString& topic) const;
+
+    /**
+     * @brief Number the events of every topic matching @p pattern, per topic
+     *
+     * Handlers read the number and the gap since their previous event of
+     * the same topic through currentSequence(), so a subscriber only needs
+     * to resynchronize when something was dropped, conflated or throttled
+     * away; events its payload filter or own-events rule rejected don't
+     * count. With several threads publishing one topic, numbers can arrive
+     * out of order; a late one reports nothing missed. At most 4096 topics
+     * are sequenced in total, so use patterns whose topics form a bounded
+     * set. Clearing a pattern releases its counters; numbering restarts if
+     * it is set again.
+     */
+    Q_INVOKABLE void setTopicSequencing(const QString& pattern);
+    Q_INVOKABLE bool clearTopicSequencing(const QString& pattern);
+
+    /**
+     * @brief Sequence of the event the calling handler runs for
+     *
+     * Only meaningful inside a subscription handler, on the thread it runs
+     * on; {0, 0} anywhere else and for topics that are not sequenced.
+     */
+    static EventSequence currentSequence();
+
+    /**
+     * @brief Record every published event into @p journal (nullptr stops recording)
+     *
+     * Publishers only hand the event to the journal's queue; encoding and
+     * writing happen on the journal's own thread.
+     */
+    void setJournal(std::shared_ptr<EventJournal> journal);
+    std::shared_ptr<EventJournal> journal() const;
+
     // Property accessor
     int totalSubscribers() const;
 
+    /**
+     * @brief Pool used by DeliveryTarget::Pool subscriptions (configurable)
+     */
+    QThreadPool* deliveryPool() { return &m_pool; }
+
 signals:
     /**
      * @brief Emitted when an event is published (for QML/C++ subscribers)
+     *
+     * Only emitted while something is connected. Every event is relayed,
+     * none are dropped, unless its topic is conflated (setTopicConflation()).
+     * Connected slots are exempt from the SlowHandlerPolicy. QML should
+     * prefer the EventSubscription element, which only receives matching
+     * topics.
      * @param topic The event topic
      * @param data The event payload
      * @param senderId The sender's plugin ID
@@ -113,37 +477,354 @@ signals:
      */
     void subscriptionRemoved(const QString& subscriptionId);
 
+    /**
+     * @brief Emitted when a slow handler is moved off-thread, see setSlowHandlerPolicy
+     */
+    void handlerDemoted(const QString& subscriptionId, const QString& subscriberId);
+
 private:
+    struct TopicData {
+        std::atomic<qint64> eventCount{0};
+        std::atomic<qint64> lastEventTime{0};
+        RateCounter rate;
+        LatencyHistogram deliveryLatency;       // publish -> handler start (us)
+        LatencyHistogram handlerTime;           // handler run time (us)
+        bool pinned = false;                    // interned topic, never evicted (guarded by m_statsLock)
+
+        void recordPublish(qint64 timestamp, qint64 now)
+        {
+            eventCount.fetch_add(1, std::memory_order_relaxed);
+            lastEventTime.store(timestamp, std::memory_order_relaxed);
+            rate.record(now);
+        }
+    };
+    using TopicDataPtr = std::shared_ptr<TopicData>;
+
+    // Eviction candidate; count is the eventCount when last looked at
+    struct TrackedTopic {
+        qint64 count = 0;
+        QString topic;
+        TopicData* data = nullptr;              // owned by m_topicStats
+    };
+
+    // publishSync waiting for one queued delivery; released once handled or dropped
+    struct SyncLatch {
+        QMutex mutex;
+        QWaitCondition done;
+        std::atomic<bool> released{false};
+
+        void release();
+        bool wait(QDeadlineTimer deadline);
+    };
+
+    // An async event, shared by every mailbox it is queued in
+    struct QueuedEvent : Event {
+        qint64 postedAt = 0;                    // EventMetrics::nowMicros() at publish
+        quint64 sequence = 0;                   // setTopicSequencing, 0 if not sequenced
+        TopicDataPtr topicData;
+        std::shared_ptr<SyncLatch> latch;       // publishSync, one mailbox only; never dropped for capacity
+    };
+    using EventPtr = std::shared_ptr<const QueuedEvent>;
+
+    struct Subscription;
+    using SubscriptionPtr = std::shared_ptr<const Subscription>;
+    struct DispatchQueue;
+
+    /**
+     * @brief Bounded queue of pending events for one subscription
+     *
+     * Drained by at most one thread at a time (scheduled stays set while a
+     * handler runs), which is what keeps per-subscription ordering.
+     */
+    struct Mailbox {
+        struct Pending {
+            EventPtr event;                     // null for conflated entries, see latest
+            QString slot;                       // conflation slot, empty if not conflated
+        };
+
+        QMutex mutex;
+        QWaitCondition notFull;                 // OverflowPolicy::Block
+        QQueue<Pending> pending;
+        QHash<QString, EventPtr> latest;        // conflation slot -> newest event
+        std::shared_ptr<DispatchQueue> queue;   // executor; null for Pool
+        bool scheduled = false;
+        bool moved = false;                     // queue was swapped while scheduled, see demote()
+        QThread* drainer = nullptr;             // running the handler, see deliverSync()
+        bool warnedOverflow = false;
+        int highWater = 0;
+        qint64 delivered = 0;
+        qint64 dropped = 0;
+        qint64 conflated = 0;
+
+        EventPtr takeFirst();                   // all with mutex held
+        void dropFirst();
+    };
+
+    /**
+     * @brief Subscriptions with pending events, served on one thread
+     *
+     * One lane per subscription priority, round-robin within a lane. The
+     * highest waiting lane goes first, so urgent deliveries overtake queued
+     * low-priority work; after a bounded run of such overtakes the lane
+     * that has waited longest gets a turn, so lower lanes keep moving.
+     */
+    struct DispatchQueue {
+        struct Ready {
+            SubscriptionPtr sub;
+            quint64 ticket;                     // order it became ready in
+        };
+
+        QObject* context = nullptr;             // lives in the serving thread
+        QMutex mutex;
+        QMap<int, QQueue<Ready>> lanes;         // priority -> ready subscriptions; no empty lanes
+        quint64 nextTicket = 0;
+        int overtakes = 0;                      // deliveries in a row while lower lanes waited
+        bool scheduled = false;
+
+        void push(const SubscriptionPtr& sub);  // all with mutex held
+        SubscriptionPtr pop();                  // null when idle
+        bool remove(const Mailbox* mailbox);    // drop its pending turn, if it has one
+    };
+    using DispatchQueuePtr = std::shared_ptr<DispatchQueue>;
+
+    /**
+     * @brief Throttle/debounce state; releases go through the bus's timer wheel
+     */
+    struct RateGate {
+        QMutex mutex;
+        EventPtr held;                          // newest event waiting for its window
+        QString slot;
+        qint64 deadline = 0;                    // us: end of the throttle window / quiet period
+        bool armed = false;                     // a wheel entry is pending
+        qint64 suppressed = 0;                  // events replaced or dropped by the gate
+    };
+
+    /**
+     * @brief Handler timing of a subscription, carried over when it is demoted
+     */
+    struct HandlerStats {
+        LatencyHistogram handlerTime;           // us, across all topics
+        std::atomic<qint64> violations{0};      // calls over the slow-handler budget
+        std::atomic<qint64> worstMicros{0};
+        QMutex mutex;                           // guards lastTopic
+        QString lastTopic;                      // topic of the latest violation
+    };
+
+    /**
+     * @brief Gap detection for one subscription
+     *
+     * Numbers the subscription rejected (payload filter, own events) are
+     * remembered as skipped, so only events it wanted and did not get
+     * count as missed.
+     */
+    struct SequenceTracker {
+        struct Topic {
+            quint64 last = 0;                   // sequence of the latest delivery, 0 before the first
+            QMap<quint64, quint64> skipped;     // first -> last of rejected runs after last
+        };
+
+        QMutex mutex;
+        QHash<QString, Topic> topics;
+        qint64 missed = 0;                      // across all topics
+
+        quint64 advance(const QString& topic, quint64 sequence);  // -> missed before this one
+        void skip(const QString& topic, quint64 sequence);
+    };
+
     struct Subscription {
         QString id;
         QString pattern;
         QString subscriberId;
         EventHandler handler;
-        SubscriptionOptions options;
-        QRegularExpression regex;
+        ExtendedSubscriptionOptions options;
+        SenderId subscriberAtom = 0;            // interned subscriberId
+        std::shared_ptr<Mailbox> mailbox;       // all targets but CallerThread
+        std::shared_ptr<RateGate> gate;         // throttleMs / debounceMs
+        std::shared_ptr<HandlerStats> stats;
+        std::shared_ptr<SequenceTracker> sequences;
+        bool demoted = false;                   // by the slow-handler policy: never runs inline
     };
 
-    struct TopicData {
-        QString topic;
-        qint64 eventCount = 0;
-        qint64 lastEventTime = 0;
+    // Priority-ordered subscribers of one topic, split by how they are reached
+    struct DeliveryPlan {
+        QList<SubscriptionPtr> all;
+        QList<SubscriptionPtr> callerThread;    // invoked inline by publish()
+        QList<SubscriptionPtr> queued;          // go through their mailbox
+        bool conflated = false;                 // topic-level conflation (setTopicConflation)
+        QString conflationKey;
+        int retainDepth = 0;                    // setTopicRetention
+        std::shared_ptr<std::atomic<quint64>> sequence;  // setTopicSequencing, null if not sequenced
+        mutable std::atomic<bool> referenced{false};     // hit since the cache's clock hand passed
+    };
+    using PlanPtr = std::shared_ptr<const DeliveryPlan>;
+
+    struct Worker {
+        QThread* thread = nullptr;
+        DispatchQueuePtr queue;
     };
 
+    /**
+     * @brief Immutable view of all subscriptions
+     *
+     * Never modified once published; only the delivery cache, which is
+     * private to this snapshot, is filled in lazily by publishers.
+     */
+    struct SubscriptionTable {
+        QHash<QString, SubscriptionPtr> subscriptions;  // subscriptionId -> Subscription
+        QHash<QString, QStringList> subscriberIndex;    // subscriberId -> [subscriptionIds]
+        TopicTrie<SubscriptionPtr> topicIndex;          // pattern segments -> Subscription
+        QHash<QString, QString> conflation;             // topic pattern -> payload key
+        TopicTrie<QString> conflationIndex;             // pattern segments -> topic pattern
+        QHash<QString, int> retention;                  // topic pattern -> depth
+        TopicTrie<QString> retentionIndex;              // pattern segments -> topic pattern
+        QSet<QString> sequencing;                       // topic patterns
+        TopicTrie<QString> sequencingIndex;             // pattern segments -> topic pattern
+        quint64 generation = 0;                         // bumped on every subscription change
+
+        // Delivery plans per concrete topic
+        mutable QReadWriteLock cacheLock;
+        mutable QHash<QString, PlanPtr> deliveryCache;
+        mutable QList<QString> deliveryClock;           // cached topics, in second-chance order
+        mutable int clockHand = 0;                      // next eviction candidate in deliveryClock
+        mutable QList<PlanPtr> atomPlans;               // TopicId -> plan
+    };
+    using TablePtr = std::shared_ptr<const SubscriptionTable>;
+
     struct RequestHandlerEntry {
         QString topic;
         QString handlerId;
         RequestHandler handler;
+        RequestHandlerOptions options;
+        DispatchQueuePtr queue;                         // OwnerThread / WorkerThread executor
+    };
+
+    // One in-flight request; whichever of reply, timeout or cancel comes first settles it
+    struct PendingRequest {
+        QMutex mutex;
+        QWaitCondition settledCondition;
+        QPromise<QVariantMap> promise;
+        std::optional<QVariantMap> reply;
+        bool settled = false;
+    };
+    using PendingRequestPtr = std::shared_ptr<PendingRequest>;
+
+    struct PendingGather {
+        QMutex mutex;
+        QPromise<QVariantMap> promise;
+        QVariantMap replies;                            // handlerId -> reply
+        int outstanding = 0;
+        int quorum = 0;
+        bool settled = false;
+    };
+
+    struct PendingEvent {
+        QMutex mutex;
+        QPromise<Event> promise;
+        QString subscriptionId;
+        bool settled = false;
     };
 
     int deliverEvent(const Event& event, bool synchronous);
-    QRegularExpression compilePattern(const QString& pattern) const;
-    QList<const Subscription*> findMatchingSubscriptions(const QString& topic) const;
+    int deliverEvent(const Event& event, bool synchronous, PlanPtr plan, SenderId sender,
+                     const TopicDataPtr& topicData, qint64 postedAt);
+    int deliverAtom(TopicId topic, const QVariantMap& data, SenderId sender, bool synchronous);
+    static bool accepts(const Subscription& sub, const Event& event, SenderId sender);
+    static bool handles(const Subscription& sub, const Event& event, SenderId sender,
+                        quint64 sequence);
+    bool hasSignalReceivers() const;
+    int invokeAll(const QList<SubscriptionPtr>& subscribers, const Event& event,
+                  SenderId sender, TopicData* topicData, qint64 postedAt, quint64 sequence);
+    void invoke(const Subscription& sub, const Event& event, TopicData* topicData,
+                qint64 postedAt, quint64 sequence);
+    void overBudget(const Subscription& sub, const Event& event, qint64 elapsed);
+    void demote(const Subscription& sub);
+    void post(const SubscriptionPtr& sub, const EventPtr& event, const QString& slot = {});
+    void rateLimit(const SubscriptionPtr& sub, const EventPtr& event, const QString& slot);
+    void releaseGate(const std::weak_ptr<const Subscription>& weak);
+    void armGate(const SubscriptionPtr& sub, qint64 deadline);
+    void postBatch(const SubscriptionPtr& sub, const QList<Mailbox::Pending>& slice);
+    void schedule(const SubscriptionPtr& sub);
+    bool enqueue(const Subscription& sub, const EventPtr& event, const QString& slot);
+    bool enqueueLocked(const Subscription& sub, const EventPtr& event, const QString& slot);
+    static QString conflationSlot(const Event& event, const QString& payloadKey);
+    bool deliverNext(const SubscriptionPtr& sub);
+    void deliverSync(const SubscriptionPtr& sub, const EventPtr& event);
+    void runDispatchQueue(const DispatchQueuePtr& queue);
+    QString addSubscription(const QString& pattern, const QString& subscriberId,
+                            EventHandler handler, const ExtendedSubscriptionOptions& options,
+                            bool announce);    // announce = log and emit the change signals
+    bool removeSubscription(const QString& subscriptionId, bool announce);
+    SubscriptionPtr makeSubscription(const QString& pattern, const QString& subscriberId,
+                                     EventHandler handler, const ExtendedSubscriptionOptions& options);
+    DispatchQueuePtr workerQueue(const QString& name);
+    QVariantMap subscriptionStats(const Subscription& sub) const;
+    TopicDataPtr topicData(const QString& topic, bool pin = false);
+    void updateAdmissionThreshold();
+    const TrackedTopic* lightestTopic();
+    static int retainDepth(const SubscriptionTable& table, const QString& topic);
+    PlanPtr retain(const EventPtr& event, int depth);
+    void trimRetained(const SubscriptionTable& table);
+    QList<EventPtr> retainedFor(const Subscription& sub) const;
+    static EventPtr makeQueuedEvent(const Event& event, qint64 postedAt, const TopicDataPtr& topicData,
+                                    quint64 sequence);
+    std::shared_ptr<std::atomic<quint64>> sequenceCounter(const QString& topic) const;
+    QVariantMap topicMetrics(const TopicData& data, qint64 now) const;
+    bool runsInline(const RequestHandlerEntry& entry) const;
+    PendingRequestPtr dispatchRequest(const RequestHandlerEntry& entry, const Event& event,
+                                      int timeoutMs);
+    static bool settleRequest(PendingRequest& pending, std::optional<QVariantMap> reply);
+    static void settleGather(PendingGather& pending);
+    RequestHandlerEntry makeHandlerEntry(const QString& topic, const QString& handlerId,
+                                         RequestHandler handler, const RequestHandlerOptions& options);
+    void execute(const RequestHandlerEntry& entry, std::function<void()> task);
 
-    mutable QMutex m_mutex;
-    QHash<QString, Subscription> m_subscriptions;       // subscriptionId -> Subscription
-    QHash<QString, QStringList> m_subscriberIndex;      // subscriberId -> [subscriptionIds]
-    QHash<QString, TopicData> m_topicStats;             // topic -> stats
+    TablePtr currentTable() const;
+    std::shared_ptr<SubscriptionTable> cloneTable() const;
+    void publishTable(std::shared_ptr<SubscriptionTable> table);
+    PlanPtr deliveryPlanFor(const SubscriptionTable& table, const QString& topic) const;
+    PlanPtr atomPlanFor(const SubscriptionTable& table, TopicId topic, const QString& name) const;
+
+    mutable QMutex m_mutex;                             // serializes writers and guards the request handlers
+    AtomicSnapshot<const SubscriptionTable> m_table;    // replaced under m_mutex, loaded by publishers
     QHash<QString, RequestHandlerEntry> m_requestHandlers; // topic -> handler
+    QHash<QString, QList<RequestHandlerEntry>> m_gatherHandlers; // topic -> gather handlers
+
+    // Exact stats for the heaviest topics only, the long tail is counted in
+    // m_topicSketch; see topicData()
+    mutable QReadWriteLock m_statsLock;                 // guards the hash, not the counters
+    QHash<QString, TopicDataPtr> m_topicStats;          // topic -> stats
+    CountMinSketch m_topicSketch;                       // untracked topics -> approximate counts
+    std::atomic<qint64> m_admissionThreshold{0};        // lightest tracked count once full
+    std::vector<TrackedTopic> m_evictionHeap;           // unpinned tracked topics, lightest on top (m_statsLock)
+
+    AtomTable<TopicDataPtr> m_topicAtoms;               // TopicId -> name, stats (shared with m_topicStats)
+    AtomTable<> m_senderAtoms;                          // SenderId -> sender/subscriber id
+
+    mutable std::atomic<qint64> m_cacheHits{0};
+    mutable std::atomic<qint64> m_cacheMisses{0};
+
+    // Retaining an event and looking up its subscribers is atomic with respect
+    // to subscribe(), so a new subscriber gets each event by replay or live,
+    // never both or neither
+    mutable QMutex m_retainedLock;
+    QHash<QString, QQueue<EventPtr>> m_retained;        // topic -> newest events, oldest first
+    bool m_warnedRetainedLimit = false;
+
+    // Sequence counters outlive subscription tables; only clearTopicSequencing() releases them
+    mutable QMutex m_sequenceLock;
+    mutable QHash<QString, std::shared_ptr<std::atomic<quint64>>> m_sequences;  // topic -> last number
+    mutable bool m_warnedSequenceLimit = false;
+
+    DispatchQueuePtr m_ownerQueue;
+    QHash<QString, Worker> m_workers;                   // name -> worker (guarded by m_mutex)
+    QThreadPool m_pool;
+    TimerWheel m_wheel;                                 // throttle/debounce deadlines
+    QTimer m_wheelTimer;                                // ticks m_wheel while it has entries
+    SlowHandlerPolicy m_slowHandlerPolicy;              // guarded by m_mutex
+    std::atomic<qint64> m_handlerBudgetMicros{16000};   // m_slowHandlerPolicy, for the hot path
+    std::atomic<int> m_demoteAfter{0};
+    SubscriptionPtr m_signalSubscription;               // queues eventPublished for async publish
+    AtomicSnapshot<EventJournal> m_journal;
 };
 
 } // namespace mpf
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <mpf/interfaces/ieventbus.h>
+
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QStringList>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
+#include <optional>
+
+class QThread;
+
+namespace mpf {
+
+class EventBusService;
+
+/**
+ * @brief One published event as stored in a journal
+ */
+struct JournalRecord
+{
+    Event event;
+    qint64 monotonicMicros = 0;     ///< EventMetrics::nowMicros() at publish, for pacing
+    bool synchronous = false;       ///< Published with publishSync
+    bool runStart = false;          ///< First record of a recording run; monotonicMicros restart here
+};
+
+/**
+ * @brief Sizing of an EventJournal
+ */
+struct JournalOptions
+{
+    qint64 segmentBytes = 64 * 1024 * 1024;     ///< Size of each mapped segment file
+    int maxSegments = 0;                        ///< Oldest segments beyond this are deleted; 0 keeps all
+    int queueCapacity = 65536;                  ///< Records waiting for the writer; more are dropped
+};
+
+/**
+ * @brief Append-only, memory-mapped, segment-rotated event journal
+ *
+ * record() only queues the event (a shared pointer, no encoding, no I/O);
+ * a writer thread encodes records and copies them into the mapped segment.
+ * When the writer falls behind by more than queueCapacity records, new
+ * records are dropped and counted rather than stalling publishers. So are
+ * records arriving while no segment can be created; the writer retries
+ * with a growing backoff.
+ *
+ * A journal opened on an existing directory appends a new recording run.
+ * Segments are named events-NNNNNN.mpfj. Each starts with a 16 byte header
+ * ("MPFJ", u16 version, u16 flags (bit 0: first segment of a run), i64
+ * creation time in ms) followed by little-endian records:
+ *
+ *   u32 size (of the rest), u8 flags (bit 0: synchronous),
+ *   i64 timestamp, i64 monotonic us, u16 + UTF-8 topic,
+ *   u16 + UTF-8 senderId, u32 + CBOR data
+ *
+ * A size of 0 ends a segment. Payload values that have no CBOR form (e.g.
+ * SharedPayload) are recorded as undefined.
+ */
+class EventJournal
+{
+public:
+    explicit EventJournal(const QString& directory, const JournalOptions& options = {});
+    ~EventJournal();
+
+    EventJournal(const EventJournal&) = delete;
+    EventJournal& operator=(const EventJournal&) = delete;
+
+    bool isOpen() const { return m_open; }
+    QString directory() const { return m_directory; }
+
+    /**
+     * @brief Queue @p event for writing; never waits for I/O
+     */
+    void record(std::shared_ptr<const Event> event, qint64 monotonicMicros, bool synchronous);
+
+    /**
+     * @brief Block until every record queued so far is in the mapped segment
+     */
+    void flush();
+
+    /**
+     * @brief {recorded, dropped, segments, bytes}
+     */
+    QVariantMap stats() const;
+
+    /**
+     * @brief Segment files of the journal in @p directory, oldest first
+     */
+    static QStringList segmentFiles(const QString& directory);
+
+private:
+    struct Pending {
+        std::shared_ptr<const Event> event;
+        qint64 monotonicMicros = 0;
+        bool synchronous = false;
+    };
+
+    void run();
+    bool write(const Pending& pending);
+    bool openSegment(qint64 minimumSize);
+    void closeSegment();
+    void pruneSegments();
+
+    const QString m_directory;
+    const JournalOptions m_options;
+    bool m_open = false;
+
+    // Queue shared with publishers
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_drained;
+    QQueue<Pending> m_queue;
+    qint64 m_enqueued = 0;
+    qint64 m_written = 0;
+    qint64 m_dropped = 0;                   ///< Queue was full
+    qint64 m_failed = 0;                    ///< No segment to write to
+    bool m_stopping = false;
+    bool m_warnedDrop = false;
+
+    // Writer thread only
+    QThread* m_writer = nullptr;
+    QFile m_segment;
+    uchar* m_map = nullptr;
+    qint64 m_segmentSize = 0;
+    qint64 m_offset = 0;
+    int m_segmentIndex = 0;
+    QDeadlineTimer m_retryAt;               ///< Next segment attempt after a failure
+    int m_retryMs = 0;                      ///< Current backoff, 0 while segments open fine
+    std::atomic<qint64> m_bytes{0};
+    std::atomic<int> m_segments{0};
+};
+
+/**
+ * @brief Sequential reader over all segments of a journal
+ */
+class EventJournalReader
+{
+public:
+    explicit EventJournalReader(const QString& directory);
+    ~EventJournalReader();
+
+    EventJournalReader(const EventJournalReader&) = delete;
+    EventJournalReader& operator=(const EventJournalReader&) = delete;
+
+    /**
+     * @brief Next record, or nullopt at the end of the journal
+     */
+    std::optional<JournalRecord> next();
+
+    int segmentCount() const { return m_files.size(); }
+
+private:
+    bool openNextSegment();
+    void closeSegment();
+
+    QStringList m_files;
+    int m_fileIndex = 0;
+    QFile m_file;
+    const uchar* m_map = nullptr;
+    qint64 m_size = 0;
+    qint64 m_offset = 0;
+    bool m_runStart = false;        ///< The next record starts a run
+};
+
+/**
+ * @brief Feeds a recorded journal back into a bus
+ *
+ * Events are published with their original topic, sender, payload and
+ * publish mode, spaced out like the original run divided by speed(). A
+ * speed of 0 publishes as fast as the event loop allows. A journal holding
+ * several runs is paced within each run; the time between runs is skipped.
+ */
+class JournalReplayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    JournalReplayer(EventBusService* bus, const QString& directory, QObject* parent = nullptr);
+    ~JournalReplayer() override;
+
+    void setSpeed(double speed) { m_speed = speed; }
+    double speed() const { return m_speed; }
+
+    void start();
+    void stop();
+    qint64 replayed() const { return m_replayed; }
+
+signals:
+    void finished();
+
+private:
+    void step();
+
+    EventBusService* m_bus;
+    EventJournalReader m_reader;
+    std::optional<JournalRecord> m_next;
+    double m_speed = 1.0;
+    QElapsedTimer m_clock;
+    qint64 m_runMicros = 0;         ///< Monotonic time of the current run's first record
+    qint64 m_runElapsed = 0;        ///< Replay clock when that record was reached
+    qint64 m_replayed = 0;
+    bool m_running = false;
+};
+
+} // namespace mpf
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <QVariantMap>
+#include <QtAlgorithms>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <limits>
+
+namespace mpf {
+
+namespace EventMetrics {
+
+/**
+ * @brief Monotonic clock shared by all bus metrics, in microseconds
+ */
+inline qint64 nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace EventMetrics
+
+/**
+ * @brief Lock-free HDR-style histogram of durations in microseconds
+ *
+ * Values below 8 us are counted exactly; above that every power of two is
+ * split into 8 linear sub-buckets, so any recorded value is reported within
+ * 12.5% of its true value, from 1 us up to several hours, in about 1 KB.
+ *
+ * record() is wait-free and may be called from any thread. Readers see a
+ * slightly torn view while writers are active, which is fine for stats.
+ */
+class LatencyHistogram
+{
+public:
+    void record(qint64 micros)
+    {
+        const quint64 value = micros > 0 ? quint64(micros) : 0;
+        m_buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        quint64 max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    qint64 count() const { return qint64(m_count.load(std::memory_order_relaxed)); }
+    qint64 max() const { return qint64(m_max.load(std::memory_order_relaxed)); }
+
+    /**
+     * @brief Smallest bucket bound that covers @p percentile (0..100) of the values
+     */
+    qint64 percentile(double percentile) const
+    {
+        const quint64 total = m_count.load(std::memory_order_relaxed);
+        if (total == 0) {
+            return 0;
+        }
+
+        const quint64 target = qMax<quint64>(1, quint64(total * percentile / 100.0 + 0.5));
+        quint64 seen = 0;
+        for (int i = 0; i < kBucketCount; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return qMin(qint64(upperBound(i)), max());
+            }
+        }
+        return max();
+    }
+
+    QVariantMap toVariantMap() const
+    {
+        const qint64 n = count();
+        QVariantMap result;
+        result["count"] = n;
+        result["mean"] = n > 0 ? double(m_sum.load(std::memory_order_relaxed)) / n : 0.0;
+        result["max"] = max();
+        result["p50"] = percentile(50);
+        result["p90"] = percentile(90);
+        result["p99"] = percentile(99);
+        result["p999"] = percentile(99.9);
+        return result;
+    }
+
+private:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxMagnitude = 35;            // 2^35 us, about 9.5 hours
+    static constexpr int kBucketCount = (kMaxMagnitude - kSubBucketBits + 2) * kSubBuckets;
+
+    static int bucketFor(quint64 value)
+    {
+        if (value < quint64(kSubBuckets)) {
+            return int(value);
+        }
+        const int magnitude = qMin(63 - int(qCountLeadingZeroBits(value)), kMaxMagnitude);
+        const int shift = magnitude - kSubBucketBits;
+        const int sub = int((value >> shift) & (kSubBuckets - 1));
+        return qMin((shift + 1) * kSubBuckets + sub, kBucketCount - 1);
+    }
+
+    static quint64 upperBound(int bucket)
+    {
+        if (bucket < kSubBuckets) {
+            return quint64(bucket);
+        }
+        const int shift = bucket / kSubBuckets - 1;
+        const quint64 lower = quint64(kSubBuckets + bucket % kSubBuckets) << shift;
+        return lower + (quint64(1) << shift) - 1;
+    }
+
+    std::array<std::atomic<quint32>, kBucketCount> m_buckets{};
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_sum{0};
+    std::atomic<quint64> m_max{0};
+};
+
+/**
+ * @brief Lock-free events-per-second counter over rolling windows of up to a minute
+ *
+ * One slot per second in a ring; a writer that enters a new second claims
+ * the slot and clears it. Counts racing with that reset may be lost, so
+ * rates are approximate under heavy contention at second boundaries.
+ */
+class RateCounter
+{
+public:
+    static constexpr int kMaxWindowSeconds = 60;
+
+    void record(qint64 nowMicros)
+    {
+        const qint64 second = nowMicros / 1000000;
+        Slot& slot = m_slots[second % kSlots];
+
+        qint64 seen = slot.second.load(std::memory_order_acquire);
+        if (seen != second && slot.second.compare_exchange_strong(seen, second, std::memory_order_acq_rel)) {
+            slot.count.store(0, std::memory_order_relaxed);
+        }
+        slot.count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Average events per second over the last @p seconds, including the current one
+     */
+    double rate(int seconds, qint64 nowMicros) const
+    {
+        seconds = qBound(1, seconds, kMaxWindowSeconds);
+        const qint64 current = nowMicros / 1000000;
+
+        qint64 events = 0;
+        for (qint64 second = current - seconds + 1; second <= current; ++second) {
+            const Slot& slot = m_slots[second % kSlots];
+            if (slot.second.load(std::memory_order_acquire) == second) {
+                events += slot.count.load(std::memory_order_relaxed);
+            }
+        }
+        return double(events) / seconds;
+    }
+
+    QVariantMap toVariantMap(qint64 nowMicros) const
+    {
+        QVariantMap result;
+        result["1s"] = rate(1, nowMicros);
+        result["10s"] = rate(10, nowMicros);
+        result["60s"] = rate(60, nowMicros);
+        return result;
+    }
+
+private:
+    static constexpr int kSlots = 64;                   // > kMaxWindowSeconds, so a window never wraps
+
+    struct Slot {
+        std::atomic<qint64> second{-1};
+        std::atomic<qint64> count{0};
+    };
+
+    std::array<Slot, kSlots> m_slots{};
+};
+
+/**
+ * @brief Lock-free count-min sketch for approximate per-key event counts
+ *
+ * Fixed size (kDepth x kWidth counters) regardless of how many distinct
+ * keys are counted. Estimates never undercount; they overcount by at most
+ * about 2/kWidth of the total with high probability.
+ *
+ * Keys are passed in as hashes so callers hash each key once.
+ */
+class CountMinSketch
+{
+public:
+    /**
+     * @brief Count one occurrence of @p hash, returning its new estimate
+     */
+    quint32 add(size_t hash)
+    {
+        quint32 estimate = std::numeric_limits<quint32>::max();
+        for (int row = 0; row < kDepth; ++row) {
+            const quint32 count = m_rows[row][column(hash, row)].fetch_add(1, std::memory_order_relaxed) + 1;
+            estimate = qMin(estimate, count);
+        }
+        return estimate;
+    }
+
+    /**
+     * @brief Make the estimate of @p hash at least @p count
+     */
+    void raise(size_t hash, quint32 count)
+    {
+        for (int row = 0; row < kDepth; ++row) {
+            std::atomic<quint32>& cell = m_rows[row][column(hash, row)];
+            quint32 current = cell.load(std::memory_order_relaxed);
+            while (current < count && !cell.compare_exchange_weak(current, count, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    quint32 estimate(size_t hash) const
+    {
+        quint32 estimate = std::numeric_limits<quint32>::max();
+        for (int row = 0; row < kDepth; ++row) {
+            estimate = qMin(estimate, m_rows[row][column(hash, row)].load(std::memory_order_relaxed));
+        }
+        return estimate;
+    }
+
+private:
+    static constexpr int kDepth = 4;
+    static constexpr int kWidth = 4096;                 // power of two
+
+    // Double hashing: row i uses h1 + i * h2, both derived from one 64-bit mix
+    static int column(size_t hash, int row)
+    {
+        quint64 mixed = quint64(hash) + 0x9e3779b97f4a7c15ull;
+        mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ull;
+        mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebull;
+        mixed ^= mixed >> 31;
+        const quint32 h1 = quint32(mixed);
+        const quint32 h2 = quint32(mixed >> 32) | 1;
+        return int((h1 + quint32(row) * h2) & (kWidth - 1));
+    }
+
+    std::array<std::array<std::atomic<quint32>, kWidth>, kDepth> m_rows{};
+};
+
+} // namespace mpf
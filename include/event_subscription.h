@@ -0,0 +1,146 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QQmlParserStatus>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <mpf/interfaces/ieventbus.h>
+
+namespace mpf {
+
+class EventBusService;
+
+/**
+ * @brief QML element receiving the events of one topic pattern
+ *
+ * Unlike a Connections block on EventBus.eventPublished, only events whose
+ * topic matches the pattern reach QML, resolved through the bus's topic
+ * index, so no JS runs for unrelated events:
+ *
+ *   import MPF.Events 1.0
+ *
+ *   EventSubscription {
+ *       pattern: "orders/*"
+ *       subscriberId: "com.example.orders"
+ *       filter: ({ region: ["eu", "us"], amount: { min: 1000 } })
+ *       onReceived: (topic, data, senderId) => console.log(topic, data.id)
+ *   }
+ *
+ * Events are delivered on the bus's thread, like any OwnerThread subscriber.
+ *
+ * For high-rate topics set delivery to EventSubscription.PerFrame: events
+ * are then buffered and handed over once per rendered frame (after the
+ * scene graph's frame swap, or at most 100 ms later if no frame comes)
+ * through receivedBatch, so the JS cost is bound by the frame rate rather
+ * than the event rate:
+ *
+ *   EventSubscription {
+ *       pattern: "telemetry/**"
+ *       delivery: EventSubscription.PerFrame
+ *       onReceivedBatch: (events) => chart.append(events)
+ *   }
+ */
+class EventSubscription : public QObject, public QQmlParserStatus
+{
+    Q_OBJECT
+    Q_INTERFACES(QQmlParserStatus)
+    Q_PROPERTY(QString pattern READ pattern WRITE setPattern NOTIFY patternChanged)
+    Q_PROPERTY(QString subscriberId READ subscriberId WRITE setSubscriberId NOTIFY subscriberIdChanged)
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(bool receiveOwnEvents READ receiveOwnEvents WRITE setReceiveOwnEvents NOTIFY receiveOwnEventsChanged)
+    Q_PROPERTY(bool active READ isActive NOTIFY activeChanged)
+    Q_PROPERTY(Delivery delivery READ delivery WRITE setDelivery NOTIFY deliveryChanged)
+    Q_PROPERTY(QVariantMap filter READ filter WRITE setFilter NOTIFY filterChanged)
+
+public:
+    enum Delivery {
+        PerEvent,   ///< received() for every event, as it is dispatched
+        PerFrame    ///< receivedBatch() once per frame with the events since the last one
+    };
+    Q_ENUM(Delivery)
+
+    explicit EventSubscription(QObject* parent = nullptr);
+    ~EventSubscription() override;
+
+    /**
+     * @brief Bus used by every element; set once by the host before loading QML
+     */
+    static void setBus(EventBusService* bus);
+
+    /**
+     * @brief Register the element as MPF.Events 1.0 EventSubscription
+     */
+    static void registerType();
+
+    QString pattern() const { return m_pattern; }
+    void setPattern(const QString& pattern);
+
+    QString subscriberId() const { return m_subscriberId; }
+    void setSubscriberId(const QString& subscriberId);
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+
+    bool receiveOwnEvents() const { return m_receiveOwnEvents; }
+    void setReceiveOwnEvents(bool receive);
+
+    /**
+     * @brief True while subscribed on the bus
+     */
+    bool isActive() const { return !m_subscriptionId.isEmpty(); }
+
+    Delivery delivery() const { return m_delivery; }
+    void setDelivery(Delivery delivery);
+
+    /**
+     * @brief Payload filter evaluated by the bus, see PayloadFilter::fromVariantMap
+     */
+    QVariantMap filter() const { return m_filter; }
+    void setFilter(const QVariantMap& filter);
+
+    /**
+     * @brief Hand buffered PerFrame events to QML now (called by the frame clock)
+     */
+    void flushFrame();
+
+    void classBegin() override {}
+    void componentComplete() override;
+
+signals:
+    void received(const QString& topic, const QVariantMap& data, const QString& senderId);
+
+    /**
+     * @brief PerFrame delivery: list of {topic, data, senderId, timestamp} maps, oldest first
+     */
+    void receivedBatch(const QVariantList& events);
+
+    void patternChanged();
+    void subscriberIdChanged();
+    void enabledChanged();
+    void receiveOwnEventsChanged();
+    void activeChanged();
+    void deliveryChanged();
+    void filterChanged();
+
+private:
+    void resubscribe();
+    void unsubscribe();
+    void deliver(const Event& event);
+
+    static QPointer<EventBusService> s_bus;
+
+    QString m_pattern;
+    QString m_subscriberId;
+    QString m_subscriptionId;
+    QVariantMap m_filter;
+    bool m_enabled = true;
+    bool m_receiveOwnEvents = false;
+    bool m_complete = false;
+    Delivery m_delivery = PerEvent;
+    QVariantList m_frameEvents;                     // PerFrame events waiting for the next frame
+};
+
+} // namespace mpf
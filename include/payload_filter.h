@@ -0,0 +1,153 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantList>
+#include <QVariantMap>
+
+namespace mpf {
+
+/**
+ * @brief Declarative predicate over an event payload
+ *
+ * A list of conditions that must all hold. The bus evaluates it on the
+ * publishing thread before an event is queued for the subscriber, so
+ * rejected events never enter its mailbox or reach its handler:
+ *
+ *   ExtendedSubscriptionOptions options;
+ *   options.filter = PayloadFilter()
+ *       .in("region", {"eu", "us"})
+ *       .range("amount", 1000, {})              // amount >= 1000
+ *       .equals("customer.tier", "gold");       // nested field
+ *
+ * Field names may be dotted paths into nested maps. A missing field fails
+ * every condition. Values compare like QVariant (numbers across types);
+ * an invalid QVariant leaves that end of a range open.
+ */
+class PayloadFilter
+{
+public:
+    /**
+     * @brief Filter from a map such as {"region": ["eu", "us"], "amount": {"min": 1000}}
+     *
+     * A list means in(), a map with "min" and/or "max" means range(), any
+     * other value means equals(). Used for filters written in QML.
+     */
+    static PayloadFilter fromVariantMap(const QVariantMap& spec)
+    {
+        PayloadFilter filter;
+        for (auto it = spec.constBegin(); it != spec.constEnd(); ++it) {
+            const QVariant& value = it.value();
+            if (value.metaType() == QMetaType::fromType<QVariantList>()) {
+                filter.in(it.key(), value.toList());
+            } else if (value.metaType() == QMetaType::fromType<QVariantMap>()
+                       && (value.toMap().contains("min") || value.toMap().contains("max"))) {
+                const QVariantMap bounds = value.toMap();
+                filter.range(it.key(), bounds.value("min"), bounds.value("max"));
+            } else {
+                filter.equals(it.key(), value);
+            }
+        }
+        return filter;
+    }
+
+    PayloadFilter& equals(const QString& field, const QVariant& value)
+    {
+        m_conditions.append({path(field), Equals, {value}});
+        return *this;
+    }
+
+    PayloadFilter& in(const QString& field, const QVariantList& values)
+    {
+        m_conditions.append({path(field), In, values});
+        return *this;
+    }
+
+    /**
+     * @brief @p min <= field <= @p max (inclusive; invalid bound = open)
+     */
+    PayloadFilter& range(const QString& field, const QVariant& min, const QVariant& max)
+    {
+        m_conditions.append({path(field), Range, {min, max}});
+        return *this;
+    }
+
+    bool isEmpty() const { return m_conditions.isEmpty(); }
+
+    bool matches(const QVariantMap& data) const
+    {
+        for (const Condition& condition : m_conditions) {
+            if (!condition.matches(data)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    enum Op { Equals, In, Range };
+
+    struct Condition {
+        QStringList path;
+        Op op;
+        QVariantList operands;
+
+        bool matches(const QVariantMap& data) const
+        {
+            const QVariant* value = lookup(data);
+            if (!value) {
+                return false;
+            }
+
+            switch (op) {
+            case Equals:
+                return *value == operands.first();
+            case In:
+                return operands.contains(*value);
+            case Range: {
+                const QVariant& min = operands.at(0);
+                const QVariant& max = operands.at(1);
+                if (min.isValid() && !isAtLeast(*value, min)) {
+                    return false;
+                }
+                return !max.isValid() || isAtLeast(max, *value);
+            }
+            }
+            return false;
+        }
+
+        // No copies: walks the map with constFind down to the leaf
+        const QVariant* lookup(const QVariantMap& data) const
+        {
+            const QVariantMap* map = &data;
+            for (qsizetype i = 0; i < path.size(); ++i) {
+                const auto it = map->constFind(path.at(i));
+                if (it == map->constEnd()) {
+                    return nullptr;
+                }
+                if (i == path.size() - 1) {
+                    return &*it;
+                }
+                if (it->metaType() != QMetaType::fromType<QVariantMap>()) {
+                    return nullptr;
+                }
+                map = static_cast<const QVariantMap*>(it->constData());
+            }
+            return nullptr;
+        }
+
+        static bool isAtLeast(const QVariant& value, const QVariant& bound)
+        {
+            const QPartialOrdering order = QVariant::compare(value, bound);
+            return order == QPartialOrdering::Greater || order == QPartialOrdering::Equivalent;
+        }
+    };
+
+    static QStringList path(const QString& field) { return field.split('.'); }
+
+    QList<Condition> m_conditions;
+};
+
+} // namespace mpf
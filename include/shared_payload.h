@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QMetaType>
+#include <QString>
+#include <QVariant>
+
+#include <memory>
+
+namespace mpf {
+
+/**
+ * @brief Immutable, reference-counted payload buffer for events
+ *
+ * Put large blobs (image buffers, serialized JSON, ...) into an event as a
+ * SharedPayload instead of a QByteArray: every subscriber then reads the
+ * same buffer instead of a copy per subscriber and request/response hop.
+ *
+ * The buffer can't be modified after construction. bytes() hands out an
+ * implicitly shared QByteArray, so a receiver that writes to it detaches
+ * its own copy and never affects other subscribers.
+ *
+ * A buffer is freed by code of the module that built it, which may be a
+ * plugin that is unloaded by then. The host therefore copies a payload
+ * once when it crosses into the bus (publish, request data and replies,
+ * via CrossDllSafety::deepCopy() and adoptPayloads()); the copy is host
+ * owned and passed through untouched from there on. Only payloads that are
+ * top-level values of the event data are adopted that way.
+ */
+class SharedPayload
+{
+    Q_GADGET
+    Q_PROPERTY(qsizetype size READ size CONSTANT)
+    Q_PROPERTY(QString mimeType READ mimeType CONSTANT)
+
+public:
+    SharedPayload() = default;
+
+    /**
+     * @brief Take over @p bytes (no copy when the caller moves them in)
+     */
+    static SharedPayload fromBytes(QByteArray bytes, const QString& mimeType = {})
+    {
+        SharedPayload payload;
+        payload.d = std::make_shared<const Buffer>(Buffer{std::move(bytes), mimeType});
+        return payload;
+    }
+
+    /**
+     * @brief Payload carried by @p value, null if it holds something else
+     */
+    static SharedPayload fromVariant(const QVariant& value)
+    {
+        return value.metaType() == QMetaType::fromType<SharedPayload>()
+            ? value.value<SharedPayload>() : SharedPayload();
+    }
+
+    QVariant toVariant() const { return QVariant::fromValue(*this); }
+
+    /**
+     * @brief Host-owned equivalent: *this if it already is one, else a copy
+     *
+     * The copy's bytes, MIME type and reference count all live in the
+     * module calling this, which is meant to be the host.
+     */
+    SharedPayload adopted() const
+    {
+        if (!d || d->adopted) {
+            return *this;
+        }
+        SharedPayload payload;
+        payload.d = std::make_shared<const Buffer>(Buffer{
+            QByteArray(d->bytes.constData(), d->bytes.size()),
+            QString(d->mimeType.constData(), d->mimeType.size()),
+            true});
+        return payload;
+    }
+
+    bool isNull() const { return !d; }
+    qsizetype size() const { return d ? d->bytes.size() : 0; }
+    const char* constData() const { return d ? d->bytes.constData() : nullptr; }
+    QByteArrayView view() const { return d ? QByteArrayView(d->bytes) : QByteArrayView(); }
+    QByteArray bytes() const { return d ? d->bytes : QByteArray(); }
+    QString mimeType() const { return d ? d->mimeType : QString(); }
+
+    /**
+     * @brief Number of SharedPayload handles sharing this buffer
+     */
+    long useCount() const { return d.use_count(); }
+
+    bool operator==(const SharedPayload& other) const { return d == other.d; }
+    bool operator!=(const SharedPayload& other) const { return d != other.d; }
+
+private:
+    struct Buffer {
+        QByteArray bytes;
+        QString mimeType;
+        bool adopted = false;               // built by adopted()
+    };
+
+    std::shared_ptr<const Buffer> d;
+};
+
+} // namespace mpf
+
+Q_DECLARE_METATYPE(mpf::SharedPayload)
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "event_metrics.h"
+
+#include <QList>
+#include <QMutex>
+
+#include <functional>
+#include <vector>
+
+namespace mpf {
+
+/**
+ * @brief Hashed timer wheel: many one-shot deadlines driven by a single ticking timer
+ *
+ * Deadlines are rounded up to the next tick and hashed into a ring of
+ * slots by tick number, so scheduling is O(1) and a tick only looks at the
+ * entries of the slots it passes. Deadlines further out than one rotation
+ * stay in their slot until their round comes.
+ *
+ * schedule() may be called from any thread. advance() is called by the
+ * owner of the ticking timer; callbacks run there, outside the lock.
+ */
+class TimerWheel
+{
+public:
+    using Callback = std::function<void()>;
+
+    explicit TimerWheel(int tickMs = 10, int slots = 256)
+        : m_tickMicros(qint64(tickMs) * 1000)
+        , m_slots(size_t(slots))
+    {
+    }
+
+    int tickMs() const { return int(m_tickMicros / 1000); }
+
+    /**
+     * @brief Run @p callback at the first tick at or after @p dueMicros (EventMetrics clock)
+     * @return true if the wheel was idle, so the caller must start ticking
+     */
+    bool schedule(qint64 dueMicros, Callback callback)
+    {
+        QMutexLocker locker(&m_mutex);
+        const bool wasIdle = m_idle;
+        if (m_idle) {
+            m_currentTick = EventMetrics::nowMicros() / m_tickMicros;
+            m_idle = false;
+        }
+
+        const qint64 dueTick = qMax((dueMicros + m_tickMicros - 1) / m_tickMicros, m_currentTick + 1);
+        m_slots[size_t(dueTick % qint64(m_slots.size()))].append(Entry{dueTick, std::move(callback)});
+        ++m_size;
+        return wasIdle;
+    }
+
+    /**
+     * @brief Run every callback due by @p nowMicros
+     * @return true if nothing is scheduled any more, so ticking can stop
+     */
+    bool advance(qint64 nowMicros)
+    {
+        QList<Callback> due;
+        {
+            QMutexLocker locker(&m_mutex);
+            const qint64 targetTick = nowMicros / m_tickMicros;
+            const qint64 slotCount = qint64(m_slots.size());
+
+            // After a long stall every slot is visited once
+            const qint64 first = targetTick - m_currentTick >= slotCount ? 0 : m_currentTick + 1;
+            const qint64 last = targetTick - m_currentTick >= slotCount ? slotCount - 1 : targetTick;
+            for (qint64 tick = first; tick <= last; ++tick) {
+                QList<Entry>& slot = m_slots[size_t(tick % slotCount)];
+                for (qsizetype i = 0; i < slot.size();) {
+                    if (slot[i].dueTick <= targetTick) {
+                        due.append(std::move(slot[i].callback));
+                        slot.removeAt(i);
+                    } else {
+                        ++i;
+                    }
+                }
+            }
+            m_currentTick = qMax(m_currentTick, targetTick);
+            m_size -= int(due.size());
+            m_idle = m_size == 0;
+        }
+
+        for (const Callback& callback : std::as_const(due)) {
+            callback();
+        }
+
+        // Callbacks may have scheduled again
+        QMutexLocker locker(&m_mutex);
+        return m_idle;
+    }
+
+    int size() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_size;
+    }
+
+private:
+    struct Entry {
+        qint64 dueTick;
+        Callback callback;
+    };
+
+    mutable QMutex m_mutex;
+    const qint64 m_tickMicros;
+    std::vector<QList<Entry>> m_slots;
+    qint64 m_currentTick = 0;
+    int m_size = 0;
+    bool m_idle = true;
+};
+
+} // namespace mpf
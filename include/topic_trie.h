@@ -0,0 +1,337 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+
+#include <utility>
+
+namespace mpf {
+
+/**
+ * @brief Helpers for '/'-separated topic patterns
+ *
+ * A pattern segment is either a literal, "*" (exactly one non-empty level)
+ * or "**" (one or more levels). Patterns that embed a wildcard inside a
+ * segment (e.g. "ord*") are not segment patterns and fall back to a regex.
+ */
+namespace TopicPattern {
+
+inline const QString& singleWildcard()
+{
+    static const QString s = QStringLiteral("*");
+    return s;
+}
+
+inline const QString& multiWildcard()
+{
+    static const QString s = QStringLiteral("**");
+    return s;
+}
+
+/**
+ * @brief Split a topic or pattern into its levels (empty levels are kept)
+ */
+inline QStringList segments(const QString& topic)
+{
+    return topic.split(QLatin1Char('/'));
+}
+
+/**
+ * @brief True if every segment is a literal, "*" or "**"
+ */
+inline bool isSegmentPattern(const QStringList& segments)
+{
+    for (const QString& segment : segments) {
+        if (segment.contains(QLatin1Char('*'))
+            && segment != singleWildcard() && segment != multiWildcard()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compile a pattern to the equivalent anchored regex
+ *
+ * ** -> .+    (matches multiple levels, must be done first)
+ * *  -> [^/]+ (matches single level)
+ */
+inline QRegularExpression toRegex(const QString& pattern)
+{
+    QString regex = QRegularExpression::escape(pattern);
+    regex.replace("\\*\\*", "<<DOUBLE_STAR>>");  // Placeholder to avoid conflicts
+    regex.replace("\\*", "[^/]+");
+    regex.replace("<<DOUBLE_STAR>>", ".+");
+    regex = "^" + regex + "$";
+
+    return QRegularExpression(regex);
+}
+
+} // namespace TopicPattern
+
+/**
+ * @brief Segment-indexed trie of topic patterns
+ *
+ * Each level of a pattern is one edge: literals live in a hash, "*" and "**"
+ * get dedicated child slots. Matching a topic walks the trie level by level,
+ * so the cost depends on the topic depth and the wildcards on its path, not
+ * on the total number of stored patterns.
+ *
+ * Nodes are kept in a flat pool and addressed by index, which gives the trie
+ * plain value semantics (copyable, no ownership to manage).
+ *
+ * Not thread-safe; callers synchronize access.
+ */
+template <typename T>
+class TopicTrie
+{
+public:
+    TopicTrie() { clear(); }
+
+    void insert(const QString& pattern, const T& value);
+    bool remove(const QString& pattern, const T& value);
+
+    /**
+     * @brief All values whose pattern matches @p topic (each value once)
+     */
+    QList<T> match(const QString& topic) const;
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    void clear();
+
+private:
+    struct Node {
+        QHash<QString, int> children;   // literal segment -> node index
+        int star = -1;                  // "*" child
+        int doubleStar = -1;            // "**" child
+        QList<T> values;
+
+        bool isEmpty() const
+        {
+            return values.isEmpty() && children.isEmpty() && star < 0 && doubleStar < 0;
+        }
+    };
+
+    struct IrregularEntry {
+        QString pattern;
+        QRegularExpression regex;
+        T value;
+    };
+
+    int childIndex(int node, const QString& segment) const;
+    int ensureChild(int node, const QString& segment);
+    void unlinkChild(int node, const QString& segment);
+    int allocateNode();
+    bool removeAt(int node, const QStringList& segments, int pos, const T& value);
+    void collect(int node, const QStringList& segments, int pos, QList<T>& out) const;
+
+    QList<Node> m_nodes;                // m_nodes[0] is the root
+    QList<int> m_freeNodes;
+    QList<IrregularEntry> m_irregular;  // patterns with wildcards inside a segment
+    int m_multiDoubleStar = 0;          // patterns that can match along several paths
+    int m_size = 0;
+};
+
+template <typename T>
+void TopicTrie<T>::insert(const QString& pattern, const T& value)
+{
+    const QStringList segments = TopicPattern::segments(pattern);
+    ++m_size;
+
+    if (!TopicPattern::isSegmentPattern(segments)) {
+        m_irregular.append(IrregularEntry{pattern, TopicPattern::toRegex(pattern), value});
+        return;
+    }
+
+    int node = 0;
+    for (const QString& segment : segments) {
+        node = ensureChild(node, segment);
+    }
+    m_nodes[node].values.append(value);
+
+    if (segments.count(TopicPattern::multiWildcard()) > 1) {
+        ++m_multiDoubleStar;
+    }
+}
+
+template <typename T>
+bool TopicTrie<T>::remove(const QString& pattern, const T& value)
+{
+    const QStringList segments = TopicPattern::segments(pattern);
+
+    if (!TopicPattern::isSegmentPattern(segments)) {
+        for (int i = 0; i < m_irregular.size(); ++i) {
+            if (m_irregular.at(i).pattern == pattern && m_irregular.at(i).value == value) {
+                m_irregular.removeAt(i);
+                --m_size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (!removeAt(0, segments, 0, value)) {
+        return false;
+    }
+
+    --m_size;
+    if (segments.count(TopicPattern::multiWildcard()) > 1) {
+        --m_multiDoubleStar;
+    }
+    return true;
+}
+
+template <typename T>
+QList<T> TopicTrie<T>::match(const QString& topic) const
+{
+    QList<T> result;
+    if (m_size == 0) {
+        return result;
+    }
+
+    collect(0, TopicPattern::segments(topic), 0, result);
+
+    for (const IrregularEntry& entry : m_irregular) {
+        if (entry.regex.match(topic).hasMatch()) {
+            result.append(entry.value);
+        }
+    }
+    return result;
+}
+
+template <typename T>
+void TopicTrie<T>::clear()
+{
+    m_nodes = QList<Node>(1);
+    m_freeNodes.clear();
+    m_irregular.clear();
+    m_multiDoubleStar = 0;
+    m_size = 0;
+}
+
+template <typename T>
+int TopicTrie<T>::childIndex(int node, const QString& segment) const
+{
+    const Node& n = m_nodes.at(node);
+    if (segment == TopicPattern::singleWildcard()) {
+        return n.star;
+    }
+    if (segment == TopicPattern::multiWildcard()) {
+        return n.doubleStar;
+    }
+    return n.children.value(segment, -1);
+}
+
+template <typename T>
+int TopicTrie<T>::ensureChild(int node, const QString& segment)
+{
+    int child = childIndex(node, segment);
+    if (child >= 0) {
+        return child;
+    }
+
+    // Allocate first: it may grow m_nodes, so only index into it afterwards
+    child = allocateNode();
+    if (segment == TopicPattern::singleWildcard()) {
+        m_nodes[node].star = child;
+    } else if (segment == TopicPattern::multiWildcard()) {
+        m_nodes[node].doubleStar = child;
+    } else {
+        m_nodes[node].children.insert(segment, child);
+    }
+    return child;
+}
+
+template <typename T>
+void TopicTrie<T>::unlinkChild(int node, const QString& segment)
+{
+    int child = -1;
+    Node& n = m_nodes[node];
+    if (segment == TopicPattern::singleWildcard()) {
+        child = std::exchange(n.star, -1);
+    } else if (segment == TopicPattern::multiWildcard()) {
+        child = std::exchange(n.doubleStar, -1);
+    } else {
+        child = n.children.take(segment);
+    }
+
+    m_nodes[child] = Node{};
+    m_freeNodes.append(child);
+}
+
+template <typename T>
+int TopicTrie<T>::allocateNode()
+{
+    if (!m_freeNodes.isEmpty()) {
+        return m_freeNodes.takeLast();
+    }
+    m_nodes.append(Node{});
+    return m_nodes.size() - 1;
+}
+
+template <typename T>
+bool TopicTrie<T>::removeAt(int node, const QStringList& segments, int pos, const T& value)
+{
+    if (pos == segments.size()) {
+        return m_nodes[node].values.removeOne(value);
+    }
+
+    const QString& segment = segments.at(pos);
+    const int child = childIndex(node, segment);
+    if (child < 0 || !removeAt(child, segments, pos + 1, value)) {
+        return false;
+    }
+
+    // Prune branches that no longer lead to any pattern
+    if (m_nodes.at(child).isEmpty()) {
+        unlinkChild(node, segment);
+    }
+    return true;
+}
+
+template <typename T>
+void TopicTrie<T>::collect(int node, const QStringList& segments, int pos, QList<T>& out) const
+{
+    const Node& n = m_nodes.at(node);
+
+    if (pos == segments.size()) {
+        if (m_multiDoubleStar == 0) {
+            out.append(n.values);
+        } else {
+            // "**/**" and friends can reach the same node along different splits
+            for (const T& value : n.values) {
+                if (!out.contains(value)) {
+                    out.append(value);
+                }
+            }
+        }
+        return;
+    }
+
+    const QString& segment = segments.at(pos);
+
+    const int literal = n.children.value(segment, -1);
+    if (literal >= 0) {
+        collect(literal, segments, pos + 1, out);
+    }
+
+    if (n.star >= 0 && !segment.isEmpty()) {
+        collect(n.star, segments, pos + 1, out);
+    }
+
+    if (n.doubleStar >= 0) {
+        // "**" consumes one or more levels, as long as it spans at least one character
+        for (int end = pos + 1; end <= segments.size(); ++end) {
+            if (end == pos + 1 && segment.isEmpty()) {
+                continue;
+            }
+            collect(n.doubleStar, segments, end, out);
+        }
+    }
+}
+
+} // namespace mpf
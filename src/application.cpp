@@ -7,6 +7,8 @@
 #include "theme_service.h"
 #include "menu_service.h"
 #include "event_bus_service.h"
+#include "event_bus_bridge.h"
+#include "event_journal.h"
 #include "qml_context.h"
 
 #include "service_registry.h"
@@ -71,6 +73,33 @@ bool Application::initialize()
     auto* menu = new MenuService(this);
     auto* eventBus = new EventBusService(this);
 
+    // Record every event for later replay (see mpf-journal-replay)
+    const QString journalDir = qEnvironmentVariable("MPF_EVENT_JOURNAL");
+    if (!journalDir.isEmpty()) {
+        eventBus->setJournal(std::make_shared<EventJournal>(journalDir));
+    }
+
+    // Move handlers that keep exceeding the frame budget off the publishing thread
+    const int demoteAfter = qEnvironmentVariableIntValue("MPF_DEMOTE_SLOW_HANDLERS");
+    if (demoteAfter > 0) {
+        SlowHandlerPolicy policy;
+        policy.demoteAfter = demoteAfter;
+        eventBus->setSlowHandlerPolicy(policy);
+    }
+
+    // Relay events to other hosts on this machine
+    const QString bridgeName = qEnvironmentVariable("MPF_BRIDGE_NAME");
+    if (!bridgeName.isEmpty()) {
+        auto* bridge = new EventBusBridge(eventBus, bridgeName, eventBus);
+        bridge->listen();
+        for (const QString& pattern : qEnvironmentVariable("MPF_BRIDGE_TOPICS").split(',', Qt::SkipEmptyParts)) {
+            bridge->forward(pattern.trimmed());
+        }
+        for (const QString& peer : qEnvironmentVariable("MPF_BRIDGE_PEERS").split(',', Qt::SkipEmptyParts)) {
+            bridge->connectToPeer(peer.trimmed());
+        }
+    }
+
     m_registry->add<INavigation>(navigation, INavigation::apiVersion(), "host");
     m_registry->add<ISettings>(settings, ISettings::apiVersion(), "host");
     m_registry->add<ITheme>(theme, ITheme::apiVersion(), "host");
@@ -0,0 +1,717 @@
+#include "event_bus_bridge.h"
+#include "event_bus_service.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMetaObject>
+#include <QSharedMemory>
+#include <QUuid>
+#include <QtEndian>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace mpf {
+
+namespace {
+
+// Control messages: u8 type, u32 payload size, payload
+enum ControlType : quint8 {
+    Hello = 1,      ///< UTF-8 bridge name
+    Attach = 2,     ///< UTF-8 key of the sender's ring for this connection
+    Doorbell = 3,   ///< New frames in the sender's ring
+    Credit = 4      ///< The receiver made room in a ring the sender found full
+};
+constexpr int kControlHeaderSize = 5;
+
+constexpr int kMaxBacklogEvents = 65536;        // per peer, and in the outbox
+constexpr quint16 kDefineBit = 0x8000;          // string reference that defines a new id
+constexpr int kMaxStringIds = 0x7fff;
+
+// Largest ring: positions are masked in 32 bits, and QSharedMemory sizes are ints
+constexpr qsizetype kMinRingCapacity = 4096;
+constexpr qsizetype kMaxRingCapacity = qsizetype(1) << 30;
+
+// Publishing from the bridge itself; such events are not forwarded again
+thread_local bool t_injecting = false;
+
+template <typename T>
+void appendLittleEndian(QByteArray& out, T value)
+{
+    const T le = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+void appendString(QByteArray& out, const QByteArray& utf8)
+{
+    appendLittleEndian<quint16>(out, quint16(utf8.size()));
+    out.append(utf8);
+}
+
+qsizetype roundUpToPowerOfTwo(qsizetype value)
+{
+    qsizetype result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// QCborValue::fromVariant() turns what it cannot encode into undefined
+qsizetype countUndefined(const QCborValue& value)
+{
+    if (value.isUndefined()) {
+        return 1;
+    }
+    qsizetype count = 0;
+    if (value.isMap()) {
+        for (const auto& entry : value.toMap()) {
+            count += countUndefined(entry.second);
+        }
+    } else if (value.isArray()) {
+        for (const QCborValue& item : value.toArray()) {
+            count += countUndefined(item);
+        }
+    }
+    return count;
+}
+
+} // namespace
+
+// =============================================================================
+// Ring: single-producer, single-consumer byte ring in shared memory
+// =============================================================================
+
+class EventBusBridge::Ring
+{
+public:
+    static std::unique_ptr<Ring> create(const QString& key, quint32 capacity)
+    {
+        Q_ASSERT(capacity <= kMaxRingCapacity);
+        auto memory = std::make_unique<QSharedMemory>(key);
+        if (!memory->create(int(kHeaderSize + qsizetype(capacity)))) {
+            qWarning() << "EventBus: Cannot create bridge ring" << key << memory->errorString();
+            return nullptr;
+        }
+        auto* header = new (memory->data()) Header;
+        header->magic = kMagic;
+        header->capacity = capacity;
+        return std::unique_ptr<Ring>(new Ring(std::move(memory)));
+    }
+
+    static std::unique_ptr<Ring> attach(const QString& key)
+    {
+        auto memory = std::make_unique<QSharedMemory>(key);
+        if (!memory->attach()) {
+            qWarning() << "EventBus: Cannot attach bridge ring" << key << memory->errorString();
+            return nullptr;
+        }
+        const auto* header = static_cast<const Header*>(memory->constData());
+        if (memory->size() < kHeaderSize || header->magic != kMagic
+            || kHeaderSize + qsizetype(header->capacity) > memory->size()) {
+            qWarning() << "EventBus: Not a bridge ring:" << key;
+            return nullptr;
+        }
+        return std::unique_ptr<Ring>(new Ring(std::move(memory)));
+    }
+
+    QString key() const { return m_memory->key(); }
+
+    /**
+     * @brief Largest frame write() can ever take
+     */
+    quint32 maxFrameSize() const { return m_header->capacity - 4; }
+
+    /**
+     * @brief Append @p frame, or flag the reader and return false if there's no room
+     */
+    bool write(const QByteArray& frame)
+    {
+        const quint64 needed = 4 + quint64(frame.size());
+        const quint64 head = m_header->head.load(std::memory_order_relaxed);
+        if (needed > freeSpace(head, m_header->tail.load(std::memory_order_acquire))) {
+            m_header->writerWaiting.store(1);
+            // The reader may have made room before it could see the flag
+            if (needed > freeSpace(head, m_header->tail.load())) {
+                return false;
+            }
+            m_header->writerWaiting.store(0, std::memory_order_relaxed);
+        }
+
+        const quint32 size = qToLittleEndian(quint32(frame.size()));
+        copyIn(head, &size, 4);
+        copyIn(head + 4, frame.constData(), quint32(frame.size()));
+        m_header->head.store(head + needed, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest frame, false if the ring is empty
+     */
+    bool read(QByteArray& frame)
+    {
+        const quint64 tail = m_header->tail.load(std::memory_order_relaxed);
+        const quint64 head = m_header->head.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+
+        quint32 size = 0;
+        copyOut(tail, &size, 4);
+        size = qFromLittleEndian(size);
+        if (size > maxFrameSize() || 4 + quint64(size) > head - tail) {
+            qWarning() << "EventBus: Corrupt bridge ring" << key() << ", discarding its contents";
+            m_header->tail.store(head);
+            return false;
+        }
+
+        frame.resize(size);
+        copyOut(tail + 4, frame.data(), size);
+        m_header->tail.store(tail + 4 + size);
+        return true;
+    }
+
+    /**
+     * @brief True (once) if the writer found the ring full since the last call
+     */
+    bool takeWriterWaiting() { return m_header->writerWaiting.exchange(0) != 0; }
+
+private:
+    static constexpr quint32 kMagic = 0x4246504d;   // "MPFB", checked on attach
+    static constexpr qsizetype kHeaderSize = 64;
+
+    // Positions count bytes ever written/read; the ring offset is position % capacity
+    struct Header {
+        quint32 magic = 0;
+        quint32 capacity = 0;
+        std::atomic<quint64> head{0};
+        std::atomic<quint64> tail{0};
+        std::atomic<quint32> writerWaiting{0};
+    };
+    static_assert(sizeof(Header) <= kHeaderSize, "ring header must fit its slot");
+    static_assert(std::atomic<quint64>::is_always_lock_free,
+                  "ring positions are shared between processes and must be lock-free");
+
+    explicit Ring(std::unique_ptr<QSharedMemory> memory)
+        : m_memory(std::move(memory))
+        , m_header(static_cast<Header*>(m_memory->data()))
+        , m_data(static_cast<uchar*>(m_memory->data()) + kHeaderSize)
+    {
+    }
+
+    quint64 freeSpace(quint64 head, quint64 tail) const { return m_header->capacity - (head - tail); }
+
+    void copyIn(quint64 position, const void* source, quint32 size)
+    {
+        const quint32 offset = quint32(position & (m_header->capacity - 1));
+        const quint32 first = qMin(size, m_header->capacity - offset);
+        std::memcpy(m_data + offset, source, first);
+        std::memcpy(m_data, static_cast<const uchar*>(source) + first, size - first);
+    }
+
+    void copyOut(quint64 position, void* target, quint32 size) const
+    {
+        const quint32 offset = quint32(position & (m_header->capacity - 1));
+        const quint32 first = qMin(size, m_header->capacity - offset);
+        std::memcpy(target, m_data + offset, first);
+        std::memcpy(static_cast<uchar*>(target) + first, m_data, size - first);
+    }
+
+    std::unique_ptr<QSharedMemory> m_memory;
+    Header* m_header;
+    uchar* m_data;
+};
+
+// =============================================================================
+// Peer
+// =============================================================================
+
+struct EventBusBridge::Peer
+{
+    QLocalSocket* socket = nullptr;
+    QString name;                           ///< From the peer's Hello
+    std::unique_ptr<Ring> outbound;         ///< Ours, the peer reads it
+    std::unique_ptr<Ring> inbound;          ///< The peer's, we read it
+    QByteArray control;                     ///< Control bytes not parsed yet
+
+    QHash<QString, quint16> sentStrings;    ///< Topic/sender ids the peer knows
+    QHash<quint16, QString> receivedStrings;
+
+    QList<Event> backlog;                   ///< Waiting for ring space, not encoded yet
+    QByteArray stalledFrame;                ///< Encoded, waiting for ring space
+    int stalledEvents = 0;
+    bool corrupt = false;                   ///< Sent a bad frame; nothing more is read from it
+};
+
+// =============================================================================
+// EventBusBridge
+// =============================================================================
+
+EventBusBridge::EventBusBridge(EventBusService* bus, const QString& name, QObject* parent)
+    : QObject(parent)
+    , m_bus(bus)
+    , m_name(name)
+{
+}
+
+EventBusBridge::~EventBusBridge()
+{
+    if (m_bus) {
+        for (const QString& subscriptionId : std::as_const(m_forwards)) {
+            m_bus->unsubscribe(subscriptionId);
+        }
+    }
+
+    for (Peer* peer : std::as_const(m_peers)) {
+        peer->socket->disconnect(this);
+        delete peer;
+    }
+}
+
+bool EventBusBridge::listen()
+{
+    if (m_server) {
+        return m_server->isListening();
+    }
+
+    m_server = new QLocalServer(this);
+    connect(m_server, &QLocalServer::newConnection, this, [this]() {
+        while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+            addPeer(socket);
+        }
+    });
+
+    // A crashed host may have left its socket file behind
+    QLocalServer::removeServer(m_name);
+    if (!m_server->listen(m_name)) {
+        qWarning() << "EventBus: Bridge cannot listen as" << m_name << m_server->errorString();
+        return false;
+    }
+
+    qDebug() << "EventBus: Bridge listening as" << m_name;
+    return true;
+}
+
+void EventBusBridge::connectToPeer(const QString& peerName)
+{
+    auto* socket = new QLocalSocket(this);
+    connect(socket, &QLocalSocket::connected, this, [this, socket]() { addPeer(socket); });
+    connect(socket, &QLocalSocket::errorOccurred, this, [this, socket, peerName]() {
+        const bool connected = std::any_of(m_peers.cbegin(), m_peers.cend(),
+                                           [socket](const Peer* peer) { return peer->socket == socket; });
+        if (!connected) {
+            qWarning() << "EventBus: Bridge cannot connect to" << peerName << socket->errorString();
+            socket->deleteLater();
+        }
+    });
+    socket->connectToServer(peerName);
+}
+
+void EventBusBridge::forward(const QString& pattern)
+{
+    if (!m_bus || m_forwards.contains(pattern)) {
+        return;
+    }
+
+    // Collect on the publishing thread so events are batched in publish order.
+    // That is also what keeps injected events from echoing back (t_injecting),
+    // so the slow-handler watchdog must never move this handler off-thread
+    ExtendedSubscriptionOptions options;
+    options.target = DeliveryTarget::CallerThread;
+    options.receiveOwnEvents = true;
+    options.watchdog = false;
+    m_forwards.insert(pattern, m_bus->subscribe(pattern, "bridge:" + m_name,
+        [this](const Event& event) { collect(event); }, options));
+}
+
+bool EventBusBridge::stopForwarding(const QString& pattern)
+{
+    const QString subscriptionId = m_forwards.take(pattern);
+    if (subscriptionId.isEmpty()) {
+        return false;
+    }
+    if (m_bus) {
+        m_bus->unsubscribe(subscriptionId);
+    }
+    return true;
+}
+
+bool EventBusBridge::setRingCapacity(qsizetype bytes)
+{
+    const qsizetype capacity = roundUpToPowerOfTwo(qMax(bytes, kMinRingCapacity));
+    if (capacity > kMaxRingCapacity) {
+        qWarning() << "EventBus: Bridge ring capacity" << bytes << "exceeds" << kMaxRingCapacity << "bytes";
+        return false;
+    }
+    m_ringCapacity = capacity;
+    return true;
+}
+
+QStringList EventBusBridge::peers() const
+{
+    QStringList names;
+    for (const Peer* peer : m_peers) {
+        if (!peer->name.isEmpty()) {
+            names.append(peer->name);
+        }
+    }
+    return names;
+}
+
+QVariantMap EventBusBridge::stats() const
+{
+    QVariantMap result;
+    result["sent"] = m_sent;
+    result["received"] = m_received;
+    result["dropped"] = m_dropped.load();
+    result["unencodable"] = m_unencodable;
+    result["frames"] = m_frames;
+    result["peers"] = peers();
+    return result;
+}
+
+void EventBusBridge::addPeer(QLocalSocket* socket)
+{
+    const QString key = QString("mpf-bridge-%1").arg(QUuid::createUuid().toString(QUuid::Id128));
+    std::unique_ptr<Ring> outbound = Ring::create(key, quint32(m_ringCapacity));
+    if (!outbound) {
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+
+    auto* peer = new Peer;
+    peer->socket = socket;
+    peer->outbound = std::move(outbound);
+    m_peers.append(peer);
+
+    connect(socket, &QLocalSocket::readyRead, this, [this, peer]() { readControl(peer); });
+    connect(socket, &QLocalSocket::disconnected, this, [this, peer]() { removePeer(peer); });
+
+    sendControl(peer, Hello, m_name.toUtf8());
+    sendControl(peer, Attach, key.toUtf8());
+    readControl(peer);  // The peer may have spoken first
+}
+
+void EventBusBridge::removePeer(Peer* peer)
+{
+    if (!m_peers.removeOne(peer)) {
+        return;
+    }
+
+    if (!peer->backlog.isEmpty() || !peer->stalledFrame.isEmpty()) {
+        dropped(peer->backlog.size() + peer->stalledEvents);
+    }
+
+    const QString name = peer->name;
+    peer->socket->disconnect(this);
+    peer->socket->deleteLater();
+    delete peer;
+
+    if (!name.isEmpty()) {
+        qDebug() << "EventBus: Bridge peer disconnected:" << name;
+        emit peerDisconnected(name);
+    }
+}
+
+void EventBusBridge::readControl(Peer* peer)
+{
+    peer->control.append(peer->socket->readAll());
+
+    qsizetype offset = 0;
+    while (peer->control.size() - offset >= kControlHeaderSize) {
+        const uchar* header = reinterpret_cast<const uchar*>(peer->control.constData()) + offset;
+        const quint8 type = header[0];
+        const quint32 size = qFromLittleEndian<quint32>(header + 1);
+        if (peer->control.size() - offset - kControlHeaderSize < qsizetype(size)) {
+            break;
+        }
+        const QByteArray payload = peer->control.mid(offset + kControlHeaderSize, size);
+        offset += kControlHeaderSize + size;
+
+        switch (type) {
+        case Hello:
+            peer->name = QString::fromUtf8(payload);
+            qDebug() << "EventBus: Bridge peer connected:" << peer->name;
+            emit peerConnected(peer->name);
+            break;
+        case Attach:
+            attachInbound(peer, payload);
+            break;
+        case Doorbell:
+            drain(peer);
+            break;
+        case Credit:
+            flushPeer(peer);
+            break;
+        default:
+            qWarning() << "EventBus: Unknown bridge control message" << type;
+            break;
+        }
+    }
+    peer->control.remove(0, offset);
+}
+
+void EventBusBridge::sendControl(Peer* peer, quint8 type, const QByteArray& payload)
+{
+    QByteArray message;
+    message.reserve(kControlHeaderSize + payload.size());
+    appendLittleEndian<quint8>(message, type);
+    appendLittleEndian<quint32>(message, quint32(payload.size()));
+    message.append(payload);
+    peer->socket->write(message);
+}
+
+void EventBusBridge::attachInbound(Peer* peer, const QByteArray& payload)
+{
+    peer->inbound = Ring::attach(QString::fromUtf8(payload));
+    if (peer->inbound) {
+        drain(peer);  // Frames written before we attached
+    }
+}
+
+void EventBusBridge::collect(const Event& event)
+{
+    if (t_injecting) {
+        return;
+    }
+
+    QMutexLocker locker(&m_outboxLock);
+    if (m_outbox.size() >= kMaxBacklogEvents) {
+        locker.unlock();
+        dropped(1);
+        return;
+    }
+    m_outbox.append(event);
+    if (m_outbox.size() == 1) {
+        QMetaObject::invokeMethod(this, &EventBusBridge::flush, Qt::QueuedConnection);
+    }
+}
+
+void EventBusBridge::flush()
+{
+    QList<Event> events;
+    {
+        QMutexLocker locker(&m_outboxLock);
+        events.swap(m_outbox);
+    }
+
+    if (m_peers.isEmpty()) {
+        dropped(events.size());  // Nobody connected (yet, or any more)
+        return;
+    }
+
+    for (Peer* peer : std::as_const(m_peers)) {
+        const qsizetype room = kMaxBacklogEvents - peer->backlog.size();
+        if (room < events.size()) {
+            peer->backlog.append(events.mid(0, room));
+            dropped(events.size() - room);
+        } else {
+            peer->backlog.append(events);
+        }
+        flushPeer(peer);
+    }
+}
+
+/*
+ * Frame layout (little-endian):
+ *
+ *   u32 event count, then per event:
+ *   topic ref, sender ref, i64 timestamp, u32 + CBOR data
+ *
+ * A string ref is a u16: an id the peer already knows, kDefineBit | id
+ * followed by u16 + UTF-8 to define it, or 0 followed by u16 + UTF-8 for
+ * a one-off string once the id space is used up.
+ */
+void EventBusBridge::flushPeer(Peer* peer)
+{
+    const quint32 maxFrame = peer->outbound->maxFrameSize() / 4;
+
+    auto appendRef = [peer](QByteArray& out, const QString& text) {
+        const quint16 id = peer->sentStrings.value(text);
+        if (id != 0) {
+            appendLittleEndian<quint16>(out, id);
+            return;
+        }
+        quint16 ref = 0;
+        if (peer->sentStrings.size() < kMaxStringIds) {
+            const quint16 newId = quint16(peer->sentStrings.size() + 1);
+            peer->sentStrings.insert(text, newId);
+            ref = kDefineBit | newId;
+        }
+        appendLittleEndian<quint16>(out, ref);
+        appendString(out, text.toUtf8().left(0xffff));
+    };
+
+    bool wrote = false;
+    for (;;) {
+        if (peer->stalledFrame.isEmpty()) {
+            if (peer->backlog.isEmpty()) {
+                break;
+            }
+
+            // Encode right before writing, so string ids are defined in ring order
+            QByteArray frame;
+            appendLittleEndian<quint32>(frame, 0);  // count, patched below
+            int count = 0;
+            qsizetype consumed = 0;
+            while (consumed < peer->backlog.size() && quint32(frame.size()) < maxFrame) {
+                const Event& event = peer->backlog.at(consumed++);
+                const QCborValue cbor = QCborValue::fromVariant(event.data);
+                if (const qsizetype lost = countUndefined(cbor)) {
+                    if (m_unencodable == 0) {
+                        qWarning() << "EventBus: Payload on" << event.topic
+                                   << "has values CBOR cannot encode; the peer gets them as undefined";
+                    }
+                    m_unencodable += lost;
+                }
+                const QByteArray data = cbor.toCbor();
+                if (quint32(data.size() + event.topic.size() * 3 + event.senderId.size() * 3 + 32) > maxFrame) {
+                    qWarning() << "EventBus: Event on" << event.topic << "is too large for the bridge ring";
+                    dropped(1);
+                    continue;
+                }
+                appendRef(frame, event.topic);
+                appendRef(frame, event.senderId);
+                appendLittleEndian<qint64>(frame, event.timestamp);
+                appendLittleEndian<quint32>(frame, quint32(data.size()));
+                frame.append(data);
+                ++count;
+            }
+            peer->backlog.remove(0, consumed);
+            if (count == 0) {
+                continue;
+            }
+            qToLittleEndian<quint32>(quint32(count), frame.data());
+            peer->stalledFrame = std::move(frame);
+            peer->stalledEvents = count;
+        }
+
+        if (!peer->outbound->write(peer->stalledFrame)) {
+            break;  // The peer sends Credit once it has made room
+        }
+        m_sent += peer->stalledEvents;
+        ++m_frames;
+        peer->stalledFrame.clear();
+        peer->stalledEvents = 0;
+        wrote = true;
+    }
+
+    if (wrote) {
+        sendControl(peer, Doorbell);
+    }
+}
+
+void EventBusBridge::drain(Peer* peer)
+{
+    if (!peer->inbound || peer->corrupt) {
+        return;
+    }
+
+    QList<Event> events;
+    QByteArray frame;
+    while (peer->inbound->read(frame)) {
+        const uchar* data = reinterpret_cast<const uchar*>(frame.constData());
+        const qsizetype size = frame.size();
+        qsizetype offset = 0;
+
+        auto readString = [&](QString& text) {
+            if (offset + 2 > size) {
+                return false;
+            }
+            const quint16 length = qFromLittleEndian<quint16>(data + offset);
+            if (offset + 2 + length > size) {
+                return false;
+            }
+            text = QString::fromUtf8(frame.constData() + offset + 2, length);
+            offset += 2 + length;
+            return true;
+        };
+        auto readRef = [&](QString& text) {
+            if (offset + 2 > size) {
+                return false;
+            }
+            const quint16 ref = qFromLittleEndian<quint16>(data + offset);
+            offset += 2;
+            if (ref == 0) {
+                return readString(text);
+            }
+            if (ref & kDefineBit) {
+                if (!readString(text)) {
+                    return false;
+                }
+                peer->receivedStrings.insert(quint16(ref & ~kDefineBit), text);
+                return true;
+            }
+            const auto it = peer->receivedStrings.constFind(ref);
+            if (it == peer->receivedStrings.constEnd()) {
+                return false;
+            }
+            text = *it;
+            return true;
+        };
+
+        if (size < 4) {
+            continue;
+        }
+        const quint32 count = qFromLittleEndian<quint32>(data);
+        offset = 4;
+        const qsizetype frameStart = events.size();
+        for (quint32 i = 0; i < count && !peer->corrupt; ++i) {
+            Event event;
+            if (!readRef(event.topic) || !readRef(event.senderId) || offset + 12 > size) {
+                peer->corrupt = true;
+                break;
+            }
+            event.timestamp = qFromLittleEndian<qint64>(data + offset);
+            const quint32 length = qFromLittleEndian<quint32>(data + offset + 8);
+            offset += 12;
+            if (offset + qsizetype(length) > size) {
+                peer->corrupt = true;
+                break;
+            }
+            event.data = QCborValue::fromCbor(frame.mid(offset, length)).toMap().toVariantMap();
+            offset += length;
+            events.append(std::move(event));
+        }
+
+        if (peer->corrupt) {
+            // The frame may have defined string ids the writer now assumes we
+            // know, so no later frame can be trusted: drop this one whole and
+            // the peer with it. A new connection starts with fresh string tables
+            qWarning() << "EventBus: Corrupt bridge frame from" << peer->name << "- dropping the peer";
+            events.resize(frameStart);
+            peer->receivedStrings.clear();
+            QMetaObject::invokeMethod(peer->socket, &QLocalSocket::abort, Qt::QueuedConnection);
+            break;
+        }
+    }
+
+    // Room was made; let a writer that found the ring full continue
+    if (peer->inbound->takeWriterWaiting()) {
+        sendControl(peer, Credit);
+    }
+
+    if (events.isEmpty() || !m_bus) {
+        return;
+    }
+    m_received += events.size();
+    t_injecting = true;
+    m_bus->publishBatch(events);
+    t_injecting = false;
+}
+
+void EventBusBridge::dropped(qint64 count)
+{
+    m_dropped.fetch_add(count, std::memory_order_relaxed);
+    if (!m_warnedDrop.exchange(true)) {
+        qWarning() << "EventBus: Bridge" << m_name << "is dropping events, peers are not keeping up";
+    }
+}
+
+} // namespace mpf
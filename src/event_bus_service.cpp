@@ -1,23 +1,118 @@
 #include "event_bus_service.h"
 #include "cross_dll_safety.h"
+#include "event_journal.h"
 
 #include <QDateTime>
+#include <QDeadlineTimer>
+#include <QFutureWatcher>
+#include <QMetaMethod>
 #include <QMetaObject>
+#include <QReadLocker>
+#include <QTimer>
+#include <QWriteLocker>
 #include <QUuid>
 #include <QDebug>
 
 #include <algorithm>
+#include <limits>
+#include <utility>
 
 namespace mpf {
 
+using CrossDllSafety::adoptPayloads;
 using CrossDllSafety::deepCopy;
 
+namespace {
+
+// Upper bound on memoized topics per subscription table; topics embedding
+// IDs would otherwise grow it forever. Beyond it one entry is evicted per
+// miss, second-chance style, so hot topics stay cached
+constexpr int kMaxDeliveryCacheEntries = 4096;
+
+// Deliveries per dispatch queue turn before yielding back to the event loop
+constexpr int kMaxDeliveriesPerTurn = 256;
+
+// Higher-priority deliveries in a row before the longest-waiting lane is served
+constexpr int kMaxOvertakes = 16;
+
+// OverflowPolicy::Block gives up (and drops) after this long, so a stuck
+// consumer cannot wedge its publishers forever
+constexpr int kMaxBlockMs = 1000;
+
+// publishSync gives up waiting for a handler on another thread after this
+// long, so two threads publishing synchronously to each other cannot hang
+constexpr int kMaxSyncWaitMs = 5000;
+
+// request() given no timeout still stops waiting for an off-thread handler
+// after this long: two executors requesting from each other would otherwise
+// wait forever
+constexpr int kDefaultRequestTimeoutMs = 30000;
+
+// Topics with exact stats; the rest are only counted in the sketch
+constexpr int kMaxTrackedTopics = 512;
+constexpr size_t kTopicSketchSeed = 0x5eed;
+
+// Heap order of the eviction candidates: lightest on top
+constexpr auto heavierTopic = [](const auto& a, const auto& b) { return a.count > b.count; };
+
+// Upper bound on topics with retained events (setTopicRetention)
+constexpr int kMaxRetainedTopics = 4096;
+
+// Upper bound on topics with a sequence counter (setTopicSequencing)
+constexpr int kMaxSequencedTopics = 4096;
+
+// Runs of rejected numbers remembered per subscription and topic
+constexpr int kMaxSkippedRuns = 1024;
+
+// Set while a pool thread drains a mailbox or runs a request handler;
+// blocking there could starve the pool
+thread_local bool t_inPoolDrain = false;
+
+// Sequence of the event the handler running on this thread was called for
+thread_local EventSequence t_currentSequence;
+
+} // namespace
+
 EventBusService::EventBusService(QObject* parent)
     : QObject(parent)
+    , m_table(std::make_shared<SubscriptionTable>())
+    , m_ownerQueue(std::make_shared<DispatchQueue>())
 {
+    m_ownerQueue->context = this;
+
+    // eventPublished goes through a mailbox like any owner-thread subscriber,
+    // so a burst of events is emitted in one drain instead of one posted call
+    // each. Connections can't pick a capacity, so the mailbox is unbounded
+    // (setTopicConflation() is the opt-in limit), and the time spent in connected
+    // slots is not the bus's to police
+    ExtendedSubscriptionOptions signalOptions;
+    signalOptions.receiveOwnEvents = true;
+    signalOptions.queueCapacity = 0;
+    signalOptions.watchdog = false;
+    m_signalSubscription = makeSubscription(QString(), QString(), [this](const Event& event) {
+        emit eventPublished(event.topic, event.data, event.senderId);
+    }, signalOptions);
+
+    // One timer for all throttle/debounce deadlines, running only while any is pending
+    m_wheelTimer.setInterval(m_wheel.tickMs());
+    m_wheelTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_wheelTimer, &QTimer::timeout, this, [this]() {
+        if (m_wheel.advance(EventMetrics::nowMicros())) {
+            m_wheelTimer.stop();
+        }
+    });
 }
 
-EventBusService::~EventBusService() = default;
+EventBusService::~EventBusService()
+{
+    m_pool.waitForDone();
+
+    for (const Worker& worker : std::as_const(m_workers)) {
+        worker.thread->quit();
+        worker.thread->wait();
+        delete worker.queue->context;  // Thread has stopped, safe to delete from here
+    }
+}
 
 int EventBusService::publish(const QString& topic,
                               const QVariantMap& data,
@@ -26,7 +121,7 @@ int EventBusService::publish(const QString& topic,
     Event event;
     event.topic = topic;
     event.senderId = senderId;
-    event.data = data;
+    event.data = adoptPayloads(data);
     event.timestamp = QDateTime::currentMSecsSinceEpoch();
 
     return deliverEvent(event, false);  // async
@@ -39,364 +134,2360 @@ int EventBusService::publishSync(const QString& topic,
     Event event;
     event.topic = topic;
     event.senderId = senderId;
-    event.data = data;
+    event.data = adoptPayloads(data);
     event.timestamp = QDateTime::currentMSecsSinceEpoch();
 
     return deliverEvent(event, true);  // sync
 }
 
-int EventBusService::deliverEvent(const Event& event, bool synchronous)
+int EventBusService::publish(TopicId topic, const QVariantMap& data, SenderId sender)
 {
-    QList<const Subscription*> matches;
+    return deliverAtom(topic, data, sender, false);  // async
+}
 
-    {
-        QMutexLocker locker(&m_mutex);
+int EventBusService::publishSync(TopicId topic, const QVariantMap& data, SenderId sender)
+{
+    return deliverAtom(topic, data, sender, true);  // sync
+}
+
+TopicId EventBusService::registerTopic(const QString& topic)
+{
+    // The id shares its stats with the string topic, so both paths add up
+    const QString name = deepCopy(topic);
+    return m_topicAtoms.intern(name, [this, &name](TopicDataPtr& data) { data = topicData(name, true); });
+}
+
+SenderId EventBusService::registerSender(const QString& senderId)
+{
+    return m_senderAtoms.intern(deepCopy(senderId));
+}
 
-        // Update topic stats
-        TopicData& stats = m_topicStats[event.topic];
-        stats.topic = event.topic;
-        stats.eventCount++;
-        stats.lastEventTime = event.timestamp;
+QString EventBusService::topicName(TopicId topic) const
+{
+    const auto* entry = m_topicAtoms.at(topic);
+    return entry ? deepCopy(entry->name) : QString();
+}
 
-        // Find matching subscriptions
-        matches = findMatchingSubscriptions(event.topic);
+int EventBusService::deliverEvent(const Event& event, bool synchronous)
+{
+    const qint64 now = EventMetrics::nowMicros();
+    const TopicDataPtr data = topicData(event.topic);
+    if (data) {
+        data->recordPublish(event.timestamp, now);
     }
 
-    if (matches.isEmpty()) {
+    // Not m_mutex: the snapshot keeps every subscription in it alive, even
+    // if it is unsubscribed while we are still delivering
+    const PlanPtr plan = deliveryPlanFor(*currentTable(), event.topic);
+    return deliverEvent(event, synchronous, plan, 0, data, now);
+}
+
+int EventBusService::deliverAtom(TopicId topic, const QVariantMap& data, SenderId sender,
+                                 bool synchronous)
+{
+    // Lock-free array lookups only: no string hashing on this path
+    auto* topicEntry = m_topicAtoms.at(topic);
+    if (!topicEntry) {
+        qWarning() << "EventBus: Publish to unregistered topic id" << topic;
         return 0;
     }
+    const auto* senderEntry = m_senderAtoms.at(sender);
 
-    // Sort by priority (descending - higher priority first)
-    std::sort(matches.begin(), matches.end(),
-              [](const Subscription* a, const Subscription* b) {
-                  return a->options.priority > b->options.priority;
-              });
+    Event event;
+    event.topic = topicEntry->name;               // Implicitly shared, no allocation
+    event.senderId = senderEntry ? senderEntry->name : QString();
+    event.data = adoptPayloads(data);
+    event.timestamp = QDateTime::currentMSecsSinceEpoch();
 
-    int notified = 0;
+    const qint64 now = EventMetrics::nowMicros();
+    topicEntry->payload->recordPublish(event.timestamp, now);
 
-    for (const Subscription* sub : matches) {
-        // Skip if sender doesn't want own events
-        if (!sub->options.receiveOwnEvents && sub->subscriberId == event.senderId) {
-            continue;
-        }
+    const PlanPtr plan = atomPlanFor(*currentTable(), topic, topicEntry->name);
+    return deliverEvent(event, synchronous, plan, senderEntry ? sender : 0, topicEntry->payload, now);
+}
 
-        // Invoke the callback if provided
-        if (sub->handler) {
-            if (synchronous) {
-                sub->handler(event);
-            } else {
-                // Capture handler by value for async invocation
-                auto handler = sub->handler;
-                auto eventCopy = event;
-                QMetaObject::invokeMethod(this, [handler, eventCopy]() {
-                    handler(eventCopy);
-                }, Qt::QueuedConnection);
-            }
+int EventBusService::deliverEvent(const Event& event, bool synchronous, PlanPtr plan,
+                                  SenderId sender, const TopicDataPtr& topicData, qint64 postedAt)
+{
+    const quint64 sequence = plan->sequence
+        ? plan->sequence->fetch_add(1, std::memory_order_relaxed) + 1 : 0;
+
+    EventPtr shared;
+    if (plan->retainDepth > 0) {
+        shared = makeQueuedEvent(event, postedAt, topicData, sequence);
+        plan = retain(shared, plan->retainDepth);
+    }
+
+    if (const auto journal = m_journal.load()) {
+        if (!shared) {
+            shared = makeQueuedEvent(event, postedAt, topicData, sequence);
         }
+        journal->record(shared, postedAt, synchronous);
+    }
 
-        notified++;
+    if (plan->all.isEmpty()) {
+        return 0;
     }
 
-    // Emit signal for signal-based subscribers (QML etc.)
-    if (synchronous) {
-        emit eventPublished(event.topic, event.data, event.senderId);
-    } else {
-        QMetaObject::invokeMethod(this, [this, event]() {
-            emit eventPublished(event.topic, event.data, event.senderId);
-        }, Qt::QueuedConnection);
+    // Handler subscriptions are counted as they are invoked or queued, so
+    // each payload filter runs once per event
+    int notified = 0;
+    for (const SubscriptionPtr& sub : plan->all) {
+        if (!sub->handler && accepts(*sub, event, sender)) {
+            notified++;
+        }
     }
 
-    return notified;
-}
+    if (synchronous) {
+        // publishSync blocks until every handler ran, in priority order: inline
+        // for CallerThread, through the mailbox for the others so they keep
+        // their thread and order. Demoted, throttled, debounced and conflated
+        // subscriptions are only posted: their gate or slot decides whether
+        // and when this event is handled, so there is nothing to wait for
+        const QString topicSlot = plan->conflated
+            ? conflationSlot(event, plan->conflationKey) : QString();
+        for (const SubscriptionPtr& sub : plan->all) {
+            if (!handles(*sub, event, sender, sequence)) {
+                continue;
+            }
+            const QString slot = sub->options.conflate
+                ? conflationSlot(event, sub->options.conflationKey) : topicSlot;
+            if (!sub->mailbox) {
+                invoke(*sub, event, topicData.get(), postedAt, sequence);
+            } else if (sub->demoted || sub->gate || !slot.isEmpty()) {
+                if (!shared) {
+                    shared = makeQueuedEvent(event, postedAt, topicData, sequence);
+                }
+                post(sub, shared, slot);
+            } else {
+                auto waited = std::make_shared<QueuedEvent>();
+                static_cast<Event&>(*waited) = event;
+                waited->postedAt = postedAt;
+                waited->sequence = sequence;
+                waited->topicData = topicData;
+                waited->latch = std::make_shared<SyncLatch>();
+                deliverSync(sub, waited);
+            }
+            notified++;
+        }
 
-QString EventBusService::subscribe(const QString& pattern,
-                                    const QString& subscriberId,
-                                    const SubscriptionOptions& options)
-{
-    return subscribe(pattern, subscriberId, nullptr, options);
-}
+        // Emit signal for signal-based subscribers (QML etc.)
+        if (hasSignalReceivers()) {
+            emit eventPublished(event.topic, event.data, event.senderId);
+        }
+        return notified;
+    }
 
-QString EventBusService::subscribe(const QString& pattern,
-                                    const QString& subscriberId,
-                                    EventHandler handler,
-                                    const SubscriptionOptions& options)
-{
-    Subscription sub;
-    sub.id = QUuid::createUuid().toString(QUuid::WithoutBraces);
-    // Deep copy strings from plugin to ensure they're in host's heap
-    sub.pattern = deepCopy(pattern);
-    sub.subscriberId = deepCopy(subscriberId);
-    sub.handler = std::move(handler);
-    sub.options = options;
-    sub.regex = compilePattern(pattern);
+    notified += invokeAll(plan->callerThread, event, sender, topicData.get(), postedAt, sequence);
 
-    {
-        QMutexLocker locker(&m_mutex);
-        m_subscriptions.insert(sub.id, sub);
-        m_subscriberIndex[sub.subscriberId].append(sub.id);
+    // All mailboxes share a single immutable event. A thread only gets a
+    // queued call when its dispatch queue goes from idle to busy, so a burst
+    // of publishes costs one event-loop round trip, not one per subscriber.
+    if (!shared) {
+        shared = makeQueuedEvent(event, postedAt, topicData, sequence);
     }
 
-    qDebug() << "EventBus: Subscribed" << subscriberId << "to" << pattern
-             << "id:" << sub.id;
+    const QString topicSlot = plan->conflated
+        ? conflationSlot(*shared, plan->conflationKey) : QString();
 
-    emit subscriptionAdded(sub.id, pattern);
-    emit subscribersChanged();
-    emit topicsChanged();
+    for (const SubscriptionPtr& sub : plan->queued) {
+        if (handles(*sub, *shared, sender, sequence)) {
+            const QString slot = sub->options.conflate
+                ? conflationSlot(*shared, sub->options.conflationKey) : topicSlot;
+            post(sub, shared, slot);
+            notified++;
+        }
+    }
+    if (hasSignalReceivers()) {
+        post(m_signalSubscription, shared, topicSlot);
+    }
 
-    // Deep copy before returning
-    return deepCopy(sub.id);
+    return notified;
 }
 
-bool EventBusService::unsubscribe(const QString& subscriptionId)
+int EventBusService::publishBatch(const QList<Event>& events)
 {
-    QString subscriberId;
+    struct TopicBatch {
+        PlanPtr plan;
+        TopicDataPtr data;
+    };
+    struct Slice {
+        SubscriptionPtr sub;
+        QList<Mailbox::Pending> events;         // event + conflation slot, in publish order
+    };
+
+    // One snapshot for the whole batch and one plan lookup per distinct topic
+    const TablePtr table = currentTable();
+    const qint64 now = EventMetrics::nowMicros();
+    const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    QHash<QString, TopicBatch> topics;
+    QHash<const Subscription*, int> sliceIndex;
+    QList<Slice> slices;
+    auto addToSlice = [&](const SubscriptionPtr& sub, const EventPtr& event, const QString& slot) {
+        int index = sliceIndex.value(sub.get(), -1);
+        if (index < 0) {
+            index = slices.size();
+            sliceIndex.insert(sub.get(), index);
+            slices.append(Slice{sub, {}});
+        }
+        slices[index].events.append(Mailbox::Pending{event, slot});
+    };
 
-    {
-        QMutexLocker locker(&m_mutex);
+    const auto journal = m_journal.load();
+    const bool signalReceivers = hasSignalReceivers();
+    int notified = 0;
+    for (const Event& event : events) {
+        TopicBatch& batch = topics[event.topic];
+        if (!batch.plan) {
+            batch.plan = deliveryPlanFor(*table, event.topic);
+        }
+        if (!batch.data) {
+            batch.data = topicData(event.topic);  // Untracked topics keep counting in the sketch
+        }
 
-        auto it = m_subscriptions.find(subscriptionId);
-        if (it == m_subscriptions.end()) {
-            return false;
+        auto queued = std::make_shared<QueuedEvent>();
+        static_cast<Event&>(*queued) = event;
+        queued->data = adoptPayloads(event.data);
+        if (queued->timestamp == 0) {
+            queued->timestamp = timestamp;
+        }
+        queued->postedAt = now;
+        queued->topicData = batch.data;
+        if (batch.plan->sequence) {
+            queued->sequence = batch.plan->sequence->fetch_add(1, std::memory_order_relaxed) + 1;
         }
+        const EventPtr shared = std::move(queued);
 
-        subscriberId = it->subscriberId;
-        m_subscriptions.erase(it);
-        m_subscriberIndex[subscriberId].removeAll(subscriptionId);
+        if (batch.data) {
+            batch.data->recordPublish(shared->timestamp, now);
+        }
 
-        if (m_subscriberIndex[subscriberId].isEmpty()) {
-            m_subscriberIndex.remove(subscriberId);
+        // Retained topics look their subscribers up again, see retain()
+        const PlanPtr planPtr = batch.plan->retainDepth > 0
+            ? retain(shared, batch.plan->retainDepth) : batch.plan;
+        if (journal) {
+            journal->record(shared, now, false);
+        }
+        const DeliveryPlan& plan = *planPtr;
+        if (plan.all.isEmpty()) {
+            continue;
         }
-    }
 
-    qDebug() << "EventBus: Unsubscribed" << subscriptionId;
+        for (const SubscriptionPtr& sub : plan.all) {
+            if (!sub->handler && accepts(*sub, *shared, 0)) {
+                notified++;
+            }
+        }
 
-    emit subscriptionRemoved(subscriptionId);
-    emit subscribersChanged();
-    emit topicsChanged();
+        notified += invokeAll(plan.callerThread, *shared, 0, batch.data.get(), now, shared->sequence);
 
-    return true;
+        const QString topicSlot = plan.conflated
+            ? conflationSlot(*shared, plan.conflationKey) : QString();
+        for (const SubscriptionPtr& sub : plan.queued) {
+            if (handles(*sub, *shared, 0, shared->sequence)) {
+                addToSlice(sub, shared, sub->options.conflate
+                    ? conflationSlot(*shared, sub->options.conflationKey) : topicSlot);
+                notified++;
+            }
+        }
+        if (signalReceivers) {
+            addToSlice(m_signalSubscription, shared, topicSlot);
+        }
+    }
+
+    for (const Slice& slice : std::as_const(slices)) {
+        postBatch(slice.sub, slice.events);
+    }
+    return notified;
 }
 
-void EventBusService::unsubscribeAll(const QString& subscriberId)
+EventBusService::EventPtr EventBusService::makeQueuedEvent(const Event& event, qint64 postedAt,
+                                                           const TopicDataPtr& topicData,
+                                                           quint64 sequence)
 {
-    QStringList ids;
+    auto queued = std::make_shared<QueuedEvent>();
+    static_cast<Event&>(*queued) = event;
+    queued->postedAt = postedAt;
+    queued->sequence = sequence;
+    queued->topicData = topicData;
+    return queued;
+}
 
-    {
-        QMutexLocker locker(&m_mutex);
-        ids = m_subscriberIndex.take(subscriberId);
+std::shared_ptr<std::atomic<quint64>> EventBusService::sequenceCounter(const QString& topic) const
+{
+    QMutexLocker locker(&m_sequenceLock);
 
-        for (const QString& id : ids) {
-            m_subscriptions.remove(id);
+    auto it = m_sequences.constFind(topic);
+    if (it != m_sequences.constEnd()) {
+        return *it;
+    }
+    if (m_sequences.size() >= kMaxSequencedTopics) {
+        if (!m_warnedSequenceLimit) {
+            m_warnedSequenceLimit = true;
+            qWarning() << "EventBus: Sequenced topic limit reached (" << kMaxSequencedTopics
+                       << "), not sequencing" << topic;
         }
+        return nullptr;
     }
+    auto counter = std::make_shared<std::atomic<quint64>>(0);
+    m_sequences.insert(deepCopy(topic), counter);
+    return counter;
+}
 
-    for (const QString& id : ids) {
-        emit subscriptionRemoved(id);
+EventBusService::PlanPtr EventBusService::retain(const EventPtr& event, int depth)
+{
+    QMutexLocker locker(&m_retainedLock);
+
+    auto it = m_retained.find(event->topic);
+    if (it == m_retained.end()) {
+        if (m_retained.size() >= kMaxRetainedTopics) {
+            if (!m_warnedRetainedLimit) {
+                m_warnedRetainedLimit = true;
+                qWarning() << "EventBus: Retained topic limit reached (" << kMaxRetainedTopics
+                           << "), not retaining" << event->topic;
+            }
+            return deliveryPlanFor(*currentTable(), event->topic);
+        }
+        it = m_retained.insert(event->topic, {});
     }
 
-    if (!ids.isEmpty()) {
-        qDebug() << "EventBus: Unsubscribed all for" << subscriberId
-                 << "(" << ids.size() << "subscriptions)";
-        emit subscribersChanged();
-        emit topicsChanged();
+    it->enqueue(event);
+    while (it->size() > depth) {
+        it->dequeue();
     }
+
+    // Re-read under the lock: a subscriber that just replayed this event
+    // must not get it live as well
+    return deliveryPlanFor(*currentTable(), event->topic);
 }
 
-int EventBusService::subscriberCount(const QString& topic) const
+int EventBusService::retainDepth(const SubscriptionTable& table, const QString& topic)
 {
-    QMutexLocker locker(&m_mutex);
-
-    int count = 0;
-    for (auto it = m_subscriptions.constBegin(); it != m_subscriptions.constEnd(); ++it) {
-        if (it->regex.match(topic).hasMatch()) {
-            count++;
-        }
+    int depth = 0;
+    for (const QString& pattern : table.retentionIndex.match(topic)) {
+        depth = qMax(depth, table.retention.value(pattern));
     }
-    return count;
+    return depth;
 }
 
-QStringList EventBusService::activeTopics() const
+void EventBusService::trimRetained(const SubscriptionTable& table)
 {
-    QMutexLocker locker(&m_mutex);
+    QMutexLocker locker(&m_retainedLock);
 
-    QSet<QString> patterns;
-    for (auto it = m_subscriptions.constBegin(); it != m_subscriptions.constEnd(); ++it) {
-        patterns.insert(it->pattern);
+    for (auto it = m_retained.begin(); it != m_retained.end();) {
+        const int depth = retainDepth(table, it.key());
+        while (it->size() > depth) {
+            it->dequeue();
+        }
+        it = it->isEmpty() ? m_retained.erase(it) : std::next(it);
     }
-    return deepCopy(patterns.values());
 }
 
-TopicStats EventBusService::topicStats(const QString& topic) const
+QList<EventBusService::EventPtr> EventBusService::retainedFor(const Subscription& sub) const
 {
-    QMutexLocker locker(&m_mutex);
+    // Note: must be called with m_retainedLock held
+    TopicTrie<bool> pattern;
+    pattern.insert(sub.pattern, true);
 
-    TopicStats stats;
-    stats.topic = topic;
-    stats.subscriberCount = 0;
+    const int perTopic = sub.options.replay;
+    const qint64 now = EventMetrics::nowMicros();
 
-    // Count subscribers
-    for (auto it = m_subscriptions.constBegin(); it != m_subscriptions.constEnd(); ++it) {
-        if (it->regex.match(topic).hasMatch()) {
-            stats.subscriberCount++;
+    QList<EventPtr> events;
+    for (auto it = m_retained.constBegin(); it != m_retained.constEnd(); ++it) {
+        if (pattern.match(it.key()).isEmpty()) {
+            continue;
+        }
+        const qsizetype first = perTopic < 0 ? 0 : qMax<qsizetype>(0, it->size() - perTopic);
+        for (qsizetype i = first; i < it->size(); ++i) {
+            const EventPtr& event = it->at(i);
+            if (accepts(sub, *event, 0)) {
+                events.append(event);
+            }
         }
     }
 
-    // Get event stats
-    auto dataIt = m_topicStats.find(topic);
-    if (dataIt != m_topicStats.end()) {
-        stats.eventCount = dataIt->eventCount;
-        stats.lastEventTime = dataIt->lastEventTime;
+    // Across topics in publish order; replay latency is measured from now
+    std::stable_sort(events.begin(), events.end(), [](const EventPtr& a, const EventPtr& b) {
+        return a->postedAt < b->postedAt;
+    });
+    const int capacity = sub.options.queueCapacity;
+    if (capacity > 0 && events.size() > capacity) {
+        events.remove(0, events.size() - capacity);
     }
-
-    return stats;
+    for (EventPtr& event : events) {
+        event = makeQueuedEvent(*event, now, event->topicData, event->sequence);
+    }
+    return events;
 }
 
-QStringList EventBusService::subscriptionsFor(const QString& subscriberId) const
+void EventBusService::setTopicRetention(const QString& pattern, int depth)
 {
+    if (depth <= 0) {
+        clearTopicRetention(pattern);
+        return;
+    }
+
     QMutexLocker locker(&m_mutex);
-    return deepCopy(m_subscriberIndex.value(subscriberId));
-}
 
-bool EventBusService::matchesTopic(const QString& topic, const QString& pattern) const
-{
-    QRegularExpression regex = compilePattern(pattern);
-    return regex.match(topic).hasMatch();
+    auto next = cloneTable();
+    const QString key = deepCopy(pattern);
+    if (!next->retention.contains(key)) {
+        next->retentionIndex.insert(key, key);
+    }
+    next->retention.insert(key, depth);
+    trimRetained(*next);
+    publishTable(std::move(next));
 }
 
-QString EventBusService::subscribeSimple(const QString& pattern, const QString& subscriberId)
+bool EventBusService::clearTopicRetention(const QString& pattern)
 {
-    return subscribe(pattern, subscriberId, SubscriptionOptions{});
-}
+    QMutexLocker locker(&m_mutex);
 
-QVariantMap EventBusService::topicStatsAsVariant(const QString& topic) const
-{
-    return deepCopy(topicStats(topic).toVariantMap());
+    if (!currentTable()->retention.contains(pattern)) {
+        return false;
+    }
+
+    auto next = cloneTable();
+    next->retention.remove(pattern);
+    next->retentionIndex.remove(pattern, pattern);
+    trimRetained(*next);
+    publishTable(std::move(next));
+    return true;
 }
 
-int EventBusService::totalSubscribers() const
+void EventBusService::setTopicSequencing(const QString& pattern)
 {
     QMutexLocker locker(&m_mutex);
-    return m_subscriptions.size();
-}
 
-// ===== Request/Response =====
+    if (currentTable()->sequencing.contains(pattern)) {
+        return;
+    }
 
-bool EventBusService::registerHandler(const QString& topic,
-                                       const QString& handlerId,
-                                       RequestHandler handler)
+    auto next = cloneTable();
+    const QString key = deepCopy(pattern);
+    next->sequencing.insert(key);
+    next->sequencingIndex.insert(key, key);
+    publishTable(std::move(next));
+}
+
+bool EventBusService::clearTopicSequencing(const QString& pattern)
 {
     QMutexLocker locker(&m_mutex);
 
-    if (m_requestHandlers.contains(topic)) {
-        qWarning() << "EventBus: Handler already registered for topic:" << topic;
+    if (!currentTable()->sequencing.contains(pattern)) {
         return false;
     }
 
-    RequestHandlerEntry entry;
-    entry.topic = deepCopy(topic);
-    entry.handlerId = deepCopy(handlerId);
-    entry.handler = std::move(handler);
-    m_requestHandlers.insert(topic, std::move(entry));
+    auto next = cloneTable();
+    next->sequencing.remove(pattern);
+    next->sequencingIndex.remove(pattern, pattern);
 
-    qDebug() << "EventBus: Registered request handler for" << topic << "by" << handlerId;
+    // Drop the counters no other pattern covers; if the topic is sequenced
+    // again its numbering restarts, so subscribers forget it as well
+    QStringList released;
+    {
+        QMutexLocker sequenceLocker(&m_sequenceLock);
+        for (auto it = m_sequences.begin(); it != m_sequences.end();) {
+            if (next->sequencingIndex.match(it.key()).isEmpty()) {
+                released.append(it.key());
+                it = m_sequences.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_warnedSequenceLimit = false;
+    }
+    for (const SubscriptionPtr& sub : std::as_const(next->subscriptions)) {
+        QMutexLocker trackerLocker(&sub->sequences->mutex);
+        for (const QString& topic : std::as_const(released)) {
+            sub->sequences->topics.remove(topic);
+        }
+    }
+
+    publishTable(std::move(next));
     return true;
 }
 
-bool EventBusService::unregisterHandler(const QString& topic)
+EventSequence EventBusService::currentSequence()
 {
-    QMutexLocker locker(&m_mutex);
-    bool removed = m_requestHandlers.remove(topic) > 0;
-    if (removed) {
-        qDebug() << "EventBus: Unregistered request handler for" << topic;
-    }
-    return removed;
+    return t_currentSequence;
 }
 
-void EventBusService::unregisterAllHandlers(const QString& handlerId)
+quint64 EventBusService::SequenceTracker::advance(const QString& topic, quint64 sequence)
 {
-    QMutexLocker locker(&m_mutex);
+    QMutexLocker locker(&mutex);
 
-    QStringList toRemove;
-    for (auto it = m_requestHandlers.constBegin(); it != m_requestHandlers.constEnd(); ++it) {
-        if (it->handlerId == handlerId) {
-            toRemove.append(it.key());
-        }
+    Topic& state = topics[topic];
+    const bool baseline = state.last == 0;  // First delivery: nothing to compare with
+    if (!baseline && sequence <= state.last) {
+        return 0;  // Late, from a concurrent publisher
     }
 
-    for (const QString& topic : toRemove) {
-        m_requestHandlers.remove(topic);
+    // Numbers in between were either rejected by accepts() or lost
+    quint64 gap = baseline ? 0 : sequence - state.last - 1;
+    for (auto it = state.skipped.begin(); it != state.skipped.end() && it.key() < sequence;) {
+        const quint64 first = qMax(it.key(), state.last + 1);
+        const quint64 last = qMin(it.value(), sequence - 1);
+        if (!baseline && first <= last) {
+            gap -= last - first + 1;
+        }
+        const quint64 rest = it.value();
+        it = state.skipped.erase(it);
+        if (rest > sequence) {
+            state.skipped.insert(sequence + 1, rest);
+            break;
+        }
     }
 
-    if (!toRemove.isEmpty()) {
-        qDebug() << "EventBus: Unregistered all handlers for" << handlerId
-                 << "(" << toRemove.size() << "handlers)";
-    }
+    state.last = sequence;
+    missed += qint64(gap);
+    return gap;
 }
 
-std::optional<QVariantMap> EventBusService::request(const QString& topic,
-                                                     const QVariantMap& data,
-                                                     const QString& senderId,
-                                                     int timeoutMs)
+void EventBusService::SequenceTracker::skip(const QString& topic, quint64 sequence)
 {
-    Q_UNUSED(timeoutMs)  // Synchronous call, timeout not implemented yet
+    QMutexLocker locker(&mutex);
 
-    RequestHandler handler;
-    {
-        QMutexLocker locker(&m_mutex);
-        auto it = m_requestHandlers.find(topic);
-        if (it == m_requestHandlers.end()) {
-            qDebug() << "EventBus: No handler for request topic:" << topic;
-            return std::nullopt;
-        }
-        handler = it->handler;
+    Topic& state = topics[topic];
+    if (sequence <= state.last) {
+        return;
     }
 
-    Event event;
-    event.topic = topic;
-    event.senderId = senderId;
-    event.data = data;
-    event.timestamp = QDateTime::currentMSecsSinceEpoch();
+    // Runs of consecutive numbers share one entry
+    auto next = state.skipped.upperBound(sequence);
+    if (next != state.skipped.begin()) {
+        auto previous = std::prev(next);
+        if (previous.value() >= sequence) {
+            return;
+        }
+        if (previous.value() + 1 == sequence) {
+            previous.value() = sequence;
+            if (next != state.skipped.end() && next.key() == sequence + 1) {
+                previous.value() = next.value();
+                state.skipped.erase(next);
+            }
+            return;
+        }
+    }
+    if (next != state.skipped.end() && next.key() == sequence + 1) {
+        const quint64 last = next.value();
+        state.skipped.erase(next);
+        state.skipped.insert(sequence, last);
+        return;
+    }
 
-    try {
-        return deepCopy(handler(event));
-    } catch (const std::exception& e) {
-        qWarning() << "EventBus: Request handler threw exception:" << e.what();
-        return std::nullopt;
+    if (state.skipped.size() >= kMaxSkippedRuns) {
+        state.skipped.erase(state.skipped.begin());  // Worst case: a false gap, never a hidden one
     }
+    state.skipped.insert(sequence, sequence);
 }
 
-bool EventBusService::hasHandler(const QString& topic) const
+QVariantMap EventBusService::retainedValue(const QString& topic) const
 {
-    QMutexLocker locker(&m_mutex);
-    return m_requestHandlers.contains(topic);
+    QMutexLocker locker(&m_retainedLock);
+    auto it = m_retained.constFind(topic);
+    if (it == m_retained.constEnd() || it->isEmpty()) {
+        return {};
+    }
+    return deepCopy(it->last()->data);
 }
 
-QRegularExpression EventBusService::compilePattern(const QString& pattern) const
+bool EventBusService::hasSignalReceivers() const
 {
-    // Convert topic pattern to regex:
-    // ** -> .+    (matches multiple levels, must be done first)
-    // *  -> [^/]+ (matches single level)
-
-    QString regex = QRegularExpression::escape(pattern);
-    regex.replace("\\*\\*", "<<DOUBLE_STAR>>");  // Placeholder to avoid conflicts
-    regex.replace("\\*", "[^/]+");
-    regex.replace("<<DOUBLE_STAR>>", ".+");
-    regex = "^" + regex + "$";
+    // Counts QML signal handlers too; a stale answer only delays or skips
+    // one emission around a connect/disconnect
+    static const QMetaMethod signal = QMetaMethod::fromSignal(&EventBusService::eventPublished);
+    return isSignalConnected(signal);
+}
 
-    return QRegularExpression(regex);
+void EventBusService::setJournal(std::shared_ptr<EventJournal> journal)
+{
+    m_journal.store(std::move(journal));
 }
 
-QList<const EventBusService::Subscription*> EventBusService::findMatchingSubscriptions(const QString& topic) const
+std::shared_ptr<EventJournal> EventBusService::journal() const
 {
-    // Note: must be called with m_mutex held
-    QList<const Subscription*> result;
+    return m_journal.load();
+}
 
-    for (auto it = m_subscriptions.constBegin(); it != m_subscriptions.constEnd(); ++it) {
-        if (it->regex.match(topic).hasMatch()) {
-            result.append(&(*it));
-        }
+bool EventBusService::accepts(const Subscription& sub, const Event& event, SenderId sender)
+{
+    // Skip if sender doesn't want own events; interned senders compare by id
+    if (!sub.options.receiveOwnEvents
+        && (sender != 0 ? sub.subscriberAtom == sender : sub.subscriberId == event.senderId)) {
+        return false;
     }
+    return sub.options.filter.isEmpty() || sub.options.filter.matches(event.data);
+}
 
+bool EventBusService::handles(const Subscription& sub, const Event& event, SenderId sender,
+                              quint64 sequence)
+{
+    if (!sub.handler) {
+        return false;
+    }
+    if (accepts(sub, event, sender)) {
+        return true;
+    }
+    if (sequence != 0) {
+        // Not wanted is not missed
+        sub.sequences->skip(event.topic, sequence);
+    }
+    return false;
+}
+
+int EventBusService::invokeAll(const QList<SubscriptionPtr>& subscribers, const Event& event,
+                               SenderId sender, TopicData* topicData, qint64 postedAt,
+                               quint64 sequence)
+{
+    int invoked = 0;
+    for (const SubscriptionPtr& sub : subscribers) {
+        if (handles(*sub, event, sender, sequence)) {
+            invoke(*sub, event, topicData, postedAt, sequence);
+            invoked++;
+        }
+    }
+    return invoked;
+}
+
+void EventBusService::invoke(const Subscription& sub, const Event& event, TopicData* topicData,
+                             qint64 postedAt, quint64 sequence)
+{
+    EventSequence position;
+    if (sequence != 0) {
+        position.sequence = sequence;
+        position.missed = sub.sequences->advance(event.topic, sequence);
+    }
+    // Handlers may publish synchronously, which nests another delivery
+    const EventSequence outer = std::exchange(t_currentSequence, position);
+
+    const qint64 start = EventMetrics::nowMicros();
+    sub.handler(event);
+    const qint64 elapsed = EventMetrics::nowMicros() - start;
+    t_currentSequence = outer;
+
+    sub.stats->handlerTime.record(elapsed);
+    if (topicData) {
+        topicData->deliveryLatency.record(start - postedAt);
+        topicData->handlerTime.record(elapsed);
+    }
+
+    const qint64 budget = m_handlerBudgetMicros.load(std::memory_order_relaxed);
+    if (budget > 0 && elapsed > budget && sub.options.watchdog) {
+        overBudget(sub, event, elapsed);
+    }
+}
+
+void EventBusService::overBudget(const Subscription& sub, const Event& event, qint64 elapsed)
+{
+    HandlerStats& stats = *sub.stats;
+    const qint64 violations = stats.violations.fetch_add(1, std::memory_order_relaxed) + 1;
+    qint64 worst = stats.worstMicros.load(std::memory_order_relaxed);
+    while (elapsed > worst && !stats.worstMicros.compare_exchange_weak(worst, elapsed, std::memory_order_relaxed)) {
+    }
+    {
+        QMutexLocker locker(&stats.mutex);
+        stats.lastTopic = event.topic;
+    }
+
+    if (violations == 1) {
+        qWarning() << "EventBus: Slow handler of" << sub.subscriberId << "on" << event.topic
+                   << "took" << elapsed / 1000 << "ms (budget"
+                   << m_handlerBudgetMicros.load(std::memory_order_relaxed) / 1000 << "ms)";
+    }
+
+    const int demoteAfter = m_demoteAfter.load(std::memory_order_relaxed);
+    if (demoteAfter > 0 && violations >= demoteAfter && !sub.demoted) {
+        demote(sub);
+    }
+}
+
+void EventBusService::demote(const Subscription& sub)
+{
+    SubscriptionPtr demoted;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // Skips the eventPublished subscription, and one that is already
+        // demoted or unsubscribed by the time we get here
+        const SubscriptionPtr current = currentTable()->subscriptions.value(sub.id);
+        if (current.get() != &sub) {
+            return;
+        }
+
+        auto next = std::make_shared<Subscription>();
+        next->id = sub.id;
+        next->pattern = sub.pattern;
+        next->subscriberId = sub.subscriberId;
+        next->handler = sub.handler;
+        next->options = sub.options;
+        next->subscriberAtom = sub.subscriberAtom;
+        next->gate = sub.gate;
+        next->stats = sub.stats;
+        next->sequences = sub.sequences;
+        next->demoted = true;
+
+        next->mailbox = sub.mailbox;
+        if (sub.options.target == DeliveryTarget::CallerThread) {
+            next->options.target = DeliveryTarget::WorkerThread;
+            next->options.workerThread = m_slowHandlerPolicy.workerThread;
+            next->mailbox = std::make_shared<Mailbox>();
+            next->mailbox->queue = workerQueue(next->options.workerThread);
+        } else if (sub.options.target == DeliveryTarget::OwnerThread) {
+            next->options.target = DeliveryTarget::WorkerThread;
+            next->options.workerThread = m_slowHandlerPolicy.workerThread;
+            const DispatchQueuePtr worker = workerQueue(next->options.workerThread);
+
+            // Same mailbox, new executor: publishers still holding the old
+            // snapshot post into it too, and a drain in progress on the owner
+            // thread hands over to the worker, so the handler never runs on
+            // both threads and keeps its order
+            QMutexLocker mailboxLocker(&sub.mailbox->mutex);
+            sub.mailbox->queue = worker;
+            sub.mailbox->moved = sub.mailbox->scheduled;
+        }
+        // WorkerThread and Pool are already off-thread; only publishSync ran them inline
+        demoted = next;
+
+        auto table = cloneTable();
+        table->subscriptions.insert(sub.id, demoted);
+        table->topicIndex.remove(sub.pattern, current);
+        table->topicIndex.insert(sub.pattern, demoted);
+        publishTable(std::move(table));
+    }
+
+    qWarning() << "EventBus: Demoted slow handler of" << sub.subscriberId << "on" << sub.pattern
+               << "to worker thread" << demoted->options.workerThread
+               << "after" << sub.stats->violations.load(std::memory_order_relaxed) << "violations";
+    emit handlerDemoted(demoted->id, demoted->subscriberId);
+}
+
+QString EventBusService::conflationSlot(const Event& event, const QString& payloadKey)
+{
+    if (payloadKey.isEmpty()) {
+        return event.topic;
+    }
+    return event.topic + QChar(0x1f) + event.data.value(payloadKey).toString();
+}
+
+void EventBusService::post(const SubscriptionPtr& sub, const EventPtr& event, const QString& slot)
+{
+    if (sub->gate) {
+        rateLimit(sub, event, slot);
+        return;
+    }
+    if (enqueue(*sub, event, slot)) {
+        schedule(sub);
+    }
+    // else: dropped, or a drain is already scheduled and will pick it up
+}
+
+void EventBusService::postBatch(const SubscriptionPtr& sub, const QList<Mailbox::Pending>& slice)
+{
+    if (sub->gate) {
+        for (const Mailbox::Pending& item : slice) {
+            rateLimit(sub, item.event, item.slot);
+        }
+        return;
+    }
+
+    bool needsDrain = false;
+    {
+        QMutexLocker locker(&sub->mailbox->mutex);
+        for (const Mailbox::Pending& item : slice) {
+            needsDrain = enqueueLocked(*sub, item.event, item.slot) || needsDrain;
+        }
+    }
+    if (needsDrain) {
+        schedule(sub);
+    }
+}
+
+void EventBusService::rateLimit(const SubscriptionPtr& sub, const EventPtr& event, const QString& slot)
+{
+    RateGate& gate = *sub->gate;
+    const ExtendedSubscriptionOptions& options = sub->options;
+    const qint64 now = EventMetrics::nowMicros();
+
+    QMutexLocker locker(&gate.mutex);
+    if (options.debounceMs > 0) {
+        // Every event restarts the quiet period; the wheel entry re-arms itself
+        if (gate.held) {
+            ++gate.suppressed;
+        }
+        gate.held = event;
+        gate.slot = slot;
+        gate.deadline = now + qint64(options.debounceMs) * 1000;
+        if (!gate.armed) {
+            gate.armed = true;
+            const qint64 deadline = gate.deadline;
+            locker.unlock();
+            armGate(sub, deadline);
+        }
+        return;
+    }
+
+    if (!gate.armed) {
+        // Quiet period: this event opens a window
+        gate.armed = true;
+        gate.deadline = now + qint64(options.throttleMs) * 1000;
+        const qint64 deadline = gate.deadline;
+        if (!options.throttleLeading) {
+            gate.held = event;
+            gate.slot = slot;
+        }
+        locker.unlock();
+
+        armGate(sub, deadline);
+        if (options.throttleLeading && enqueue(*sub, event, slot)) {
+            schedule(sub);
+        }
+        return;
+    }
+
+    if (gate.held || !options.throttleTrailing) {
+        ++gate.suppressed;
+    }
+    if (options.throttleTrailing || !options.throttleLeading) {
+        gate.held = event;
+        gate.slot = slot;
+    }
+}
+
+void EventBusService::armGate(const SubscriptionPtr& sub, qint64 deadline)
+{
+    std::weak_ptr<const Subscription> weak = sub;
+    if (m_wheel.schedule(deadline, [this, weak]() { releaseGate(weak); })) {
+        // Direct on the owner thread, queued from others
+        QMetaObject::invokeMethod(&m_wheelTimer, qOverload<>(&QTimer::start));
+    }
+}
+
+void EventBusService::releaseGate(const std::weak_ptr<const Subscription>& weak)
+{
+    const SubscriptionPtr released = weak.lock();
+    // The current one, in case it was demoted meanwhile
+    const SubscriptionPtr sub = released ? currentTable()->subscriptions.value(released->id) : nullptr;
+    if (!sub) {
+        return;  // Unsubscribed meanwhile
+    }
+
+    RateGate& gate = *sub->gate;
+    const qint64 now = EventMetrics::nowMicros();
+    EventPtr event;
+    QString slot;
+    qint64 nextWindow = 0;
+    {
+        QMutexLocker locker(&gate.mutex);
+        if (now < gate.deadline && sub->options.debounceMs > 0) {
+            // Still bursting: wait for the new end of the quiet period
+            const qint64 deadline = gate.deadline;
+            locker.unlock();
+            armGate(sub, deadline);
+            return;
+        }
+
+        event = std::exchange(gate.held, nullptr);
+        slot = std::exchange(gate.slot, QString());
+        if (event && sub->options.debounceMs <= 0) {
+            // A trailing delivery opens the next window
+            gate.deadline = now + qint64(sub->options.throttleMs) * 1000;
+            nextWindow = gate.deadline;
+        } else {
+            gate.armed = false;
+        }
+    }
+
+    if (!event) {
+        return;
+    }
+    if (nextWindow > 0) {
+        armGate(sub, nextWindow);
+    }
+    if (enqueue(*sub, event, slot)) {
+        schedule(sub);
+    }
+}
+
+void EventBusService::schedule(const SubscriptionPtr& sub)
+{
+    DispatchQueuePtr queue;
+    {
+        // Read under the lock: demotion can swap it
+        QMutexLocker locker(&sub->mailbox->mutex);
+        queue = sub->mailbox->queue;
+    }
+
+    if (!queue) {
+        // Pool; higher priorities start first when the pool is busy
+        m_pool.start([this, sub]() {
+            t_inPoolDrain = true;
+            while (deliverNext(sub)) {
+            }
+            t_inPoolDrain = false;
+        }, sub->options.priority);
+        return;
+    }
+
+    {
+        QMutexLocker locker(&queue->mutex);
+        queue->push(sub);
+        if (queue->scheduled) {
+            return;
+        }
+        queue->scheduled = true;
+    }
+
+    QMetaObject::invokeMethod(queue->context, [this, queue]() {
+        runDispatchQueue(queue);
+    }, Qt::QueuedConnection);
+}
+
+bool EventBusService::enqueue(const Subscription& sub, const EventPtr& event, const QString& slot)
+{
+    QMutexLocker locker(&sub.mailbox->mutex);
+    return enqueueLocked(sub, event, slot);
+}
+
+bool EventBusService::enqueueLocked(const Subscription& sub, const EventPtr& event, const QString& slot)
+{
+    // Note: must be called with sub.mailbox->mutex held
+    Mailbox& mailbox = *sub.mailbox;
+
+    if (!slot.isEmpty()) {
+        auto it = mailbox.latest.find(slot);
+        if (it != mailbox.latest.end()) {
+            *it = event;  // Latest value wins, delivered at the older one's position
+            ++mailbox.conflated;
+            return false;
+        }
+    }
+
+    // A publishSync caller waits for its event, so it is never dropped; each
+    // waiting publisher adds at most one
+    const int capacity = sub.options.queueCapacity;
+    if (capacity > 0 && mailbox.pending.size() >= capacity && !event->latch) {
+        if (!mailbox.warnedOverflow) {
+            mailbox.warnedOverflow = true;
+            qWarning() << "EventBus: Mailbox full for" << sub.subscriberId << "on" << sub.pattern
+                       << "(capacity" << capacity << ")";
+        }
+
+        switch (sub.options.overflow) {
+        case OverflowPolicy::DropNewest:
+            ++mailbox.dropped;
+            return false;
+
+        case OverflowPolicy::CoalesceByKey: {
+            const QVariant key = event->data.value(sub.options.coalesceKey);
+            if (slot.isEmpty()) {
+                for (Mailbox::Pending& pending : mailbox.pending) {
+                    if (pending.slot.isEmpty() && pending.event->topic == event->topic
+                        && pending.event->data.value(sub.options.coalesceKey) == key) {
+                        if (pending.event->latch) {
+                            pending.event->latch->release();
+                        }
+                        pending.event = event;  // Keeps its place in the queue
+                        ++mailbox.dropped;
+                        return false;
+                    }
+                }
+            }
+            mailbox.dropFirst();
+            ++mailbox.dropped;
+            break;
+        }
+
+        case OverflowPolicy::Block: {
+            // Waiting on the thread that drains this mailbox would never end
+            const bool consumerThread = mailbox.queue
+                ? QThread::currentThread() == mailbox.queue->context->thread()
+                : t_inPoolDrain;
+            QDeadlineTimer deadline(kMaxBlockMs);
+            while (mailbox.pending.size() >= capacity) {
+                if (consumerThread || !mailbox.notFull.wait(&mailbox.mutex, deadline)) {
+                    ++mailbox.dropped;
+                    return false;
+                }
+                // Another publisher may have filled our slot while we waited
+                if (!slot.isEmpty() && mailbox.latest.contains(slot)) {
+                    mailbox.latest.insert(slot, event);
+                    ++mailbox.conflated;
+                    return false;
+                }
+            }
+            break;
+        }
+
+        case OverflowPolicy::DropOldest:
+            mailbox.dropFirst();
+            ++mailbox.dropped;
+            break;
+        }
+    }
+
+    if (slot.isEmpty()) {
+        mailbox.pending.enqueue(Mailbox::Pending{event, QString()});
+    } else {
+        mailbox.pending.enqueue(Mailbox::Pending{EventPtr(), slot});
+        mailbox.latest.insert(slot, event);
+    }
+    mailbox.highWater = qMax(mailbox.highWater, int(mailbox.pending.size()));
+
+    if (mailbox.scheduled) {
+        return false;
+    }
+    mailbox.scheduled = true;
+    return true;
+}
+
+bool EventBusService::deliverNext(const SubscriptionPtr& sub)
+{
+    Mailbox& mailbox = *sub->mailbox;
+    QThread* const current = QThread::currentThread();
+
+    EventPtr event;
+    QThread* outerDrainer = nullptr;            // set when a handler publishSyncs to itself
+    {
+        QMutexLocker locker(&mailbox.mutex);
+        if (mailbox.pending.isEmpty()) {
+            mailbox.scheduled = false;
+            mailbox.moved = false;
+            return false;
+        }
+        if (mailbox.moved) {
+            // Demoted while waiting here: the new executor takes over the drain
+            mailbox.moved = false;
+            locker.unlock();
+            schedule(sub);
+            return false;
+        }
+        event = mailbox.takeFirst();
+        ++mailbox.delivered;
+        mailbox.notFull.wakeOne();
+        outerDrainer = std::exchange(mailbox.drainer, current);
+    }
+
+    invoke(*sub, *event, event->topicData.get(), event->postedAt, event->sequence);
+    if (event->latch) {
+        event->latch->release();
+    }
+
+    // scheduled stays set while the handler runs, so no other thread can
+    // start draining this mailbox and reorder its events
+    QMutexLocker locker(&mailbox.mutex);
+    mailbox.drainer = outerDrainer;
+    if (mailbox.pending.isEmpty()) {
+        mailbox.scheduled = false;
+        mailbox.moved = false;
+        return false;
+    }
+    if (mailbox.moved) {
+        // Demoted by this very call; scheduled stays set across the handover
+        mailbox.moved = false;
+        locker.unlock();
+        schedule(sub);
+        return false;
+    }
+    return true;
+}
+
+EventBusService::EventPtr EventBusService::Mailbox::takeFirst()
+{
+    Pending first = pending.dequeue();
+    return first.slot.isEmpty() ? first.event : latest.take(first.slot);
+}
+
+void EventBusService::Mailbox::dropFirst()
+{
+    const Pending first = pending.dequeue();
+    if (!first.slot.isEmpty()) {
+        latest.remove(first.slot);
+    } else if (first.event->latch) {
+        first.event->latch->release();  // Made room for a newer event; its publisher stops waiting
+    }
+}
+
+void EventBusService::SyncLatch::release()
+{
+    QMutexLocker locker(&mutex);
+    released.store(true, std::memory_order_release);
+    done.wakeAll();
+}
+
+bool EventBusService::SyncLatch::wait(QDeadlineTimer deadline)
+{
+    QMutexLocker locker(&mutex);
+    while (!released.load(std::memory_order_acquire)) {
+        if (!done.wait(&mutex, deadline)) {
+            return released.load(std::memory_order_acquire);
+        }
+    }
+    return true;
+}
+
+void EventBusService::deliverSync(const SubscriptionPtr& sub, const EventPtr& event)
+{
+    Mailbox& mailbox = *sub->mailbox;
+    SyncLatch& latch = *event->latch;
+    QThread* const current = QThread::currentThread();
+
+    // Drain here when this thread may run the handler and no other thread
+    // can be draining it: a handler of this subscription publishing (the
+    // drain is up our stack), an idle mailbox on its own executor, or a
+    // turn queued on this very thread, which we take over
+    bool drain = false;
+    bool nested = false;
+    bool start = false;
+    {
+        QMutexLocker locker(&mailbox.mutex);
+        const bool claimed = enqueueLocked(*sub, event, QString());
+        const DispatchQueuePtr queue = mailbox.queue;
+        const bool ownThread = queue ? queue->context->thread() == current : t_inPoolDrain;
+
+        if (mailbox.drainer == current) {
+            drain = nested = true;
+        } else if (claimed) {
+            drain = ownThread;
+            start = !ownThread;
+        } else if (ownThread && queue) {
+            QMutexLocker queueLocker(&queue->mutex);
+            drain = queue->remove(&mailbox);
+        }
+    }
+
+    if (start) {
+        schedule(sub);
+    }
+    if (drain) {
+        bool more = true;
+        while (more && !latch.released.load(std::memory_order_acquire)) {
+            more = deliverNext(sub);
+        }
+        if (more && !nested) {
+            schedule(sub);  // The rest goes back to its executor
+        }
+        // Not handled yet only if it was demoted meanwhile; its worker has it now
+    }
+
+    if (!latch.wait(QDeadlineTimer(kMaxSyncWaitMs))) {
+        qWarning() << "EventBus: publishSync stopped waiting for" << sub->subscriberId << "on"
+                   << event->topic << "after" << kMaxSyncWaitMs << "ms, it is still queued";
+    }
+}
+
+void EventBusService::DispatchQueue::push(const SubscriptionPtr& sub)
+{
+    lanes[sub->options.priority].enqueue(Ready{sub, nextTicket++});
+}
+
+EventBusService::SubscriptionPtr EventBusService::DispatchQueue::pop()
+{
+    if (lanes.isEmpty()) {
+        return nullptr;
+    }
+
+    auto lane = std::prev(lanes.end());  // Highest priority
+    if (lanes.size() == 1) {
+        overtakes = 0;
+    } else if (++overtakes > kMaxOvertakes) {
+        // Starvation guard: whichever lane's head became ready first
+        overtakes = 0;
+        for (auto it = lanes.begin(); it != lanes.end(); ++it) {
+            if (it->head().ticket < lane->head().ticket) {
+                lane = it;
+            }
+        }
+    }
+
+    const SubscriptionPtr sub = lane->dequeue().sub;
+    if (lane->isEmpty()) {
+        lanes.erase(lane);
+    }
+    return sub;
+}
+
+bool EventBusService::DispatchQueue::remove(const Mailbox* mailbox)
+{
+    // Note: must be called with mutex held
+    for (auto lane = lanes.begin(); lane != lanes.end(); ++lane) {
+        for (auto it = lane->begin(); it != lane->end(); ++it) {
+            if (it->sub->mailbox.get() == mailbox) {
+                lane->erase(it);
+                if (lane->isEmpty()) {
+                    lanes.erase(lane);
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void EventBusService::runDispatchQueue(const DispatchQueuePtr& queue)
+{
+    // One event per subscription per turn, highest priority lane first and
+    // round-robin within a lane, re-checked before every delivery so events
+    // published meanwhile can overtake. The turn is capped so other events
+    // on this thread's loop keep running during a flood.
+    for (int served = 0; served < kMaxDeliveriesPerTurn; ++served) {
+        SubscriptionPtr sub;
+        {
+            QMutexLocker locker(&queue->mutex);
+            sub = queue->pop();
+            if (!sub) {
+                queue->scheduled = false;
+                return;
+            }
+        }
+
+        if (deliverNext(sub)) {
+            QMutexLocker locker(&queue->mutex);
+            queue->push(sub);
+        }
+    }
+
+    QMetaObject::invokeMethod(queue->context, [this, queue]() {
+        runDispatchQueue(queue);
+    }, Qt::QueuedConnection);
+}
+
+EventBusService::DispatchQueuePtr EventBusService::workerQueue(const QString& name)
+{
+    // Note: must be called with m_mutex held
+    auto it = m_workers.constFind(name);
+    if (it != m_workers.constEnd()) {
+        return it->queue;
+    }
+
+    Worker worker;
+    worker.thread = new QThread(this);
+    worker.thread->setObjectName("EventBus:" + name);
+    worker.queue = std::make_shared<DispatchQueue>();
+    worker.queue->context = new QObject;
+    worker.queue->context->moveToThread(worker.thread);
+    worker.thread->start();
+
+    m_workers.insert(name, worker);
+    qDebug() << "EventBus: Started worker thread" << name;
+    return worker.queue;
+}
+
+EventBusService::SubscriptionPtr EventBusService::makeSubscription(const QString& pattern,
+                                                                   const QString& subscriberId,
+                                                                   EventHandler handler,
+                                                                   const ExtendedSubscriptionOptions& options)
+{
+    // Note: must be called with m_mutex held when options.target is WorkerThread
+    auto sub = std::make_shared<Subscription>();
+    sub->id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    // Deep copy strings from plugin to ensure they're in host's heap
+    sub->pattern = deepCopy(pattern);
+    sub->subscriberId = deepCopy(subscriberId);
+    sub->handler = std::move(handler);
+    sub->options = options;
+    sub->options.workerThread = deepCopy(options.workerThread);
+    sub->options.coalesceKey = deepCopy(options.coalesceKey);
+    sub->subscriberAtom = subscriberId.isEmpty() ? 0 : m_senderAtoms.intern(sub->subscriberId);
+    sub->stats = std::make_shared<HandlerStats>();
+    sub->sequences = std::make_shared<SequenceTracker>();
+
+    if (options.debounceMs > 0 || options.throttleMs > 0) {
+        sub->gate = std::make_shared<RateGate>();
+        // Delayed deliveries have no publishing thread to run on
+        if (sub->options.target == DeliveryTarget::CallerThread) {
+            sub->options.target = DeliveryTarget::OwnerThread;
+        }
+    }
+
+    switch (sub->options.target) {
+    case DeliveryTarget::CallerThread:
+        break;
+    case DeliveryTarget::OwnerThread:
+        sub->mailbox = std::make_shared<Mailbox>();
+        sub->mailbox->queue = m_ownerQueue;
+        break;
+    case DeliveryTarget::WorkerThread:
+        sub->mailbox = std::make_shared<Mailbox>();
+        sub->mailbox->queue = workerQueue(sub->options.workerThread);
+        break;
+    case DeliveryTarget::Pool:
+        sub->mailbox = std::make_shared<Mailbox>();
+        break;
+    }
+
+    return sub;
+}
+
+QString EventBusService::subscribe(const QString& pattern,
+                                    const QString& subscriberId,
+                                    const SubscriptionOptions& options)
+{
+    return subscribe(pattern, subscriberId, nullptr, options);
+}
+
+QString EventBusService::subscribe(const QString& pattern,
+                                    const QString& subscriberId,
+                                    EventHandler handler,
+                                    const SubscriptionOptions& options)
+{
+    ExtendedSubscriptionOptions extended;
+    static_cast<SubscriptionOptions&>(extended) = options;
+    return subscribe(pattern, subscriberId, std::move(handler), extended);
+}
+
+QString EventBusService::subscribe(const QString& pattern,
+                                    const QString& subscriberId,
+                                    EventHandler handler,
+                                    const ExtendedSubscriptionOptions& options)
+{
+    return addSubscription(pattern, subscriberId, std::move(handler), options, true);
+}
+
+QString EventBusService::addSubscription(const QString& pattern,
+                                          const QString& subscriberId,
+                                          EventHandler handler,
+                                          const ExtendedSubscriptionOptions& options,
+                                          bool announce)
+{
+    SubscriptionPtr sub;
+    QList<EventPtr> replay;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        sub = makeSubscription(pattern, subscriberId, std::move(handler), options);
+
+        auto next = cloneTable();
+        next->subscriptions.insert(sub->id, sub);
+        next->subscriberIndex[sub->subscriberId].append(sub->id);
+        next->topicIndex.insert(sub->pattern, sub);
+
+        if (sub->handler && options.replay != 0) {
+            // Publishers retain and look up subscribers under the same lock,
+            // so each event is either replayed here or delivered live
+            QMutexLocker retainedLocker(&m_retainedLock);
+            replay = retainedFor(*sub);
+            if (sub->mailbox) {
+                // Queued before the subscription is visible, so ahead of any live event
+                for (const EventPtr& event : std::as_const(replay)) {
+                    post(sub, event, sub->options.conflate
+                        ? conflationSlot(*event, sub->options.conflationKey) : QString());
+                }
+                replay.clear();
+            }
+            publishTable(std::move(next));
+        } else {
+            publishTable(std::move(next));
+        }
+    }
+
+    // CallerThread subscriptions replay inline, before subscribe() returns
+    for (const EventPtr& event : std::as_const(replay)) {
+        invoke(*sub, *event, event->topicData.get(), event->postedAt, event->sequence);
+    }
+
+    if (announce) {
+        qDebug() << "EventBus: Subscribed" << subscriberId << "to" << pattern
+                 << "id:" << sub->id;
+
+        emit subscriptionAdded(sub->id, pattern);
+        emit subscribersChanged();
+        emit topicsChanged();
+    }
+
+    // Deep copy before returning
+    return deepCopy(sub->id);
+}
+
+bool EventBusService::unsubscribe(const QString& subscriptionId)
+{
+    return removeSubscription(subscriptionId, true);
+}
+
+bool EventBusService::removeSubscription(const QString& subscriptionId, bool announce)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const SubscriptionPtr sub = currentTable()->subscriptions.value(subscriptionId);
+        if (!sub) {
+            return false;
+        }
+
+        auto next = cloneTable();
+        next->subscriptions.remove(subscriptionId);
+        next->topicIndex.remove(sub->pattern, sub);
+
+        QStringList& ids = next->subscriberIndex[sub->subscriberId];
+        ids.removeAll(subscriptionId);
+        if (ids.isEmpty()) {
+            next->subscriberIndex.remove(sub->subscriberId);
+        }
+
+        publishTable(std::move(next));
+    }
+
+    if (announce) {
+        qDebug() << "EventBus: Unsubscribed" << subscriptionId;
+
+        emit subscriptionRemoved(subscriptionId);
+        emit subscribersChanged();
+        emit topicsChanged();
+    }
+
+    return true;
+}
+
+void EventBusService::unsubscribeAll(const QString& subscriberId)
+{
+    QStringList ids;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (!currentTable()->subscriberIndex.contains(subscriberId)) {
+            return;
+        }
+
+        auto next = cloneTable();
+        ids = next->subscriberIndex.take(subscriberId);
+
+        for (const QString& id : ids) {
+            const SubscriptionPtr sub = next->subscriptions.take(id);
+            if (sub) {
+                next->topicIndex.remove(sub->pattern, sub);
+            }
+        }
+
+        publishTable(std::move(next));
+    }
+
+    for (const QString& id : ids) {
+        emit subscriptionRemoved(id);
+    }
+
+    if (!ids.isEmpty()) {
+        qDebug() << "EventBus: Unsubscribed all for" << subscriberId
+                 << "(" << ids.size() << "subscriptions)";
+        emit subscribersChanged();
+        emit topicsChanged();
+    }
+}
+
+int EventBusService::subscriberCount(const QString& topic) const
+{
+    return currentTable()->topicIndex.match(topic).size();
+}
+
+QStringList EventBusService::activeTopics() const
+{
+    const TablePtr table = currentTable();
+
+    QSet<QString> patterns;
+    for (auto it = table->subscriptions.constBegin(); it != table->subscriptions.constEnd(); ++it) {
+        patterns.insert((*it)->pattern);
+    }
+    return deepCopy(patterns.values());
+}
+
+TopicStats EventBusService::topicStats(const QString& topic) const
+{
+    TopicStats stats;
+    stats.topic = topic;
+    stats.subscriberCount = currentTable()->topicIndex.match(topic).size();
+
+    // Get event stats
+    QReadLocker locker(&m_statsLock);
+    auto dataIt = m_topicStats.constFind(topic);
+    if (dataIt != m_topicStats.constEnd()) {
+        stats.eventCount = (*dataIt)->eventCount.load(std::memory_order_relaxed);
+        stats.lastEventTime = (*dataIt)->lastEventTime.load(std::memory_order_relaxed);
+    } else {
+        // Long tail: approximate count only
+        stats.eventCount = m_topicSketch.estimate(qHash(topic, kTopicSketchSeed));
+    }
+
+    return stats;
+}
+
+QStringList EventBusService::subscriptionsFor(const QString& subscriberId) const
+{
+    return deepCopy(currentTable()->subscriberIndex.value(subscriberId));
+}
+
+bool EventBusService::matchesTopic(const QString& topic, const QString& pattern) const
+{
+    return TopicPattern::toRegex(pattern).match(topic).hasMatch();
+}
+
+QString EventBusService::subscribeSimple(const QString& pattern, const QString& subscriberId)
+{
+    return subscribe(pattern, subscriberId, SubscriptionOptions{});
+}
+
+QVariantMap EventBusService::topicStatsAsVariant(const QString& topic) const
+{
+    QVariantMap result = topicStats(topic).toVariantMap();
+
+    TopicDataPtr data;
+    {
+        QReadLocker locker(&m_statsLock);
+        data = m_topicStats.value(topic);
+    }
+    if (data) {
+        const QVariantMap metrics = topicMetrics(*data, EventMetrics::nowMicros());
+        for (auto it = metrics.constBegin(); it != metrics.constEnd(); ++it) {
+            result.insert(it.key(), it.value());
+        }
+    }
+    result["exact"] = bool(data);  // false: eventCount is a sketch estimate
+
+    // Per-subscription mailbox counters for everything this topic reaches
+    QVariantList subscriptions;
+    for (const SubscriptionPtr& sub : currentTable()->topicIndex.match(topic)) {
+        subscriptions.append(subscriptionStats(*sub));
+    }
+    result["subscriptions"] = subscriptions;
+
+    return deepCopy(result);
+}
+
+QVariantMap EventBusService::deliveryCacheStats() const
+{
+    const TablePtr table = currentTable();
+
+    QVariantMap result;
+    result["hits"] = qint64(m_cacheHits.load(std::memory_order_relaxed));
+    result["misses"] = qint64(m_cacheMisses.load(std::memory_order_relaxed));
+    {
+        QReadLocker locker(&table->cacheLock);
+        result["entries"] = int(table->deliveryCache.size());
+    }
+    result["generation"] = table->generation;
+    return result;
+}
+
+QVariantMap EventBusService::subscriptionStats(const QString& subscriptionId) const
+{
+    const SubscriptionPtr sub = currentTable()->subscriptions.value(subscriptionId);
+    if (!sub) {
+        return {};
+    }
+    return deepCopy(subscriptionStats(*sub));
+}
+
+QVariantMap EventBusService::subscriptionStats(const Subscription& sub) const
+{
+    QVariantMap result;
+    result["id"] = sub.id;
+    result["pattern"] = sub.pattern;
+    result["subscriberId"] = sub.subscriberId;
+    result["capacity"] = sub.options.queueCapacity;
+
+    if (sub.mailbox) {
+        QMutexLocker locker(&sub.mailbox->mutex);
+        result["queueDepth"] = int(sub.mailbox->pending.size());
+        result["highWater"] = sub.mailbox->highWater;
+        result["delivered"] = sub.mailbox->delivered;
+        result["dropped"] = sub.mailbox->dropped;
+        result["conflated"] = sub.mailbox->conflated;
+    } else {
+        // CallerThread: delivered inline, never queued
+        result["queueDepth"] = 0;
+        result["highWater"] = 0;
+        result["delivered"] = qint64(0);
+        result["dropped"] = qint64(0);
+        result["conflated"] = qint64(0);
+    }
+    result["suppressed"] = qint64(0);
+    if (sub.gate) {
+        QMutexLocker locker(&sub.gate->mutex);
+        result["suppressed"] = sub.gate->suppressed;
+    }
+    result["violations"] = sub.stats->violations.load(std::memory_order_relaxed);
+    {
+        QMutexLocker locker(&sub.sequences->mutex);
+        result["missed"] = sub.sequences->missed;
+    }
+    result["handlerTimeUs"] = sub.stats->handlerTime.toVariantMap();
+    return result;
+}
+
+QVariantMap EventBusService::metricsSnapshot() const
+{
+    const qint64 now = EventMetrics::nowMicros();
+
+    QList<QPair<QString, TopicDataPtr>> topics;
+    {
+        QReadLocker locker(&m_statsLock);
+        topics.reserve(m_topicStats.size());
+        for (auto it = m_topicStats.constBegin(); it != m_topicStats.constEnd(); ++it) {
+            topics.emplace_back(it.key(), it.value());
+        }
+    }
+
+    QVariantList topicList;
+    topicList.reserve(topics.size());
+    for (const auto& [topic, data] : std::as_const(topics)) {
+        QVariantMap entry = topicMetrics(*data, now);
+        entry["topic"] = topic;
+        topicList.append(entry);
+    }
+
+    QVariantList subscriptionList;
+    const TablePtr table = currentTable();
+    for (const SubscriptionPtr& sub : table->subscriptions) {
+        QVariantMap entry;
+        entry["id"] = sub->id;
+        entry["pattern"] = sub->pattern;
+        entry["subscriberId"] = sub->subscriberId;
+        entry["handlerTimeUs"] = sub->stats->handlerTime.toVariantMap();
+        subscriptionList.append(entry);
+    }
+
+    QVariantMap result;
+    result["topics"] = topicList;
+    result["subscriptions"] = subscriptionList;
+    return deepCopy(result);
+}
+
+void EventBusService::setSlowHandlerPolicy(const SlowHandlerPolicy& policy)
+{
+    QMutexLocker locker(&m_mutex);
+    m_slowHandlerPolicy = policy;
+    m_slowHandlerPolicy.workerThread = deepCopy(policy.workerThread);
+    m_handlerBudgetMicros.store(qint64(qMax(0, policy.budgetMs)) * 1000, std::memory_order_relaxed);
+    m_demoteAfter.store(qMax(0, policy.demoteAfter), std::memory_order_relaxed);
+}
+
+SlowHandlerPolicy EventBusService::slowHandlerPolicy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_slowHandlerPolicy;
+}
+
+QVariantList EventBusService::slowHandlers() const
+{
+    QList<SubscriptionPtr> offenders;
+    const TablePtr table = currentTable();
+    for (const SubscriptionPtr& sub : table->subscriptions) {
+        if (sub->stats->violations.load(std::memory_order_relaxed) > 0) {
+            offenders.append(sub);
+        }
+    }
+    std::sort(offenders.begin(), offenders.end(), [](const SubscriptionPtr& a, const SubscriptionPtr& b) {
+        return a->stats->violations.load(std::memory_order_relaxed)
+            > b->stats->violations.load(std::memory_order_relaxed);
+    });
+
+    QVariantList result;
+    for (const SubscriptionPtr& sub : std::as_const(offenders)) {
+        HandlerStats& stats = *sub->stats;
+        QVariantMap entry;
+        entry["id"] = sub->id;
+        entry["pattern"] = sub->pattern;
+        entry["subscriberId"] = sub->subscriberId;
+        entry["violations"] = stats.violations.load(std::memory_order_relaxed);
+        entry["worstUs"] = stats.worstMicros.load(std::memory_order_relaxed);
+        {
+            QMutexLocker locker(&stats.mutex);
+            entry["lastTopic"] = stats.lastTopic;
+        }
+        entry["demoted"] = sub->demoted;
+        entry["handlerTimeUs"] = stats.handlerTime.toVariantMap();
+        result.append(entry);
+    }
+    return deepCopy(result);
+}
+
+void EventBusService::setTopicConflation(const QString& pattern, const QString& payloadKey)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto next = cloneTable();
+    const QString key = deepCopy(pattern);
+    if (!next->conflation.contains(key)) {
+        next->conflationIndex.insert(key, key);
+    }
+    next->conflation.insert(key, deepCopy(payloadKey));
+    publishTable(std::move(next));
+}
+
+bool EventBusService::clearTopicConflation(const QString& pattern)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!currentTable()->conflation.contains(pattern)) {
+        return false;
+    }
+
+    auto next = cloneTable();
+    next->conflation.remove(pattern);
+    next->conflationIndex.remove(pattern, pattern);
+    publishTable(std::move(next));
+    return true;
+}
+
+int EventBusService::totalSubscribers() const
+{
+    return currentTable()->subscriptions.size();
+}
+
+// ===== Request/Response =====
+
+bool EventBusService::registerHandler(const QString& topic,
+                                       const QString& handlerId,
+                                       RequestHandler handler)
+{
+    return registerHandler(topic, handlerId, std::move(handler), RequestHandlerOptions{});
+}
+
+bool EventBusService::registerHandler(const QString& topic,
+                                       const QString& handlerId,
+                                       RequestHandler handler,
+                                       const RequestHandlerOptions& options)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_requestHandlers.contains(topic)) {
+        qWarning() << "EventBus: Handler already registered for topic:" << topic;
+        return false;
+    }
+
+    m_requestHandlers.insert(topic, makeHandlerEntry(topic, handlerId, std::move(handler), options));
+
+    qDebug() << "EventBus: Registered request handler for" << topic << "by" << handlerId;
+    return true;
+}
+
+bool EventBusService::registerGatherHandler(const QString& topic,
+                                            const QString& handlerId,
+                                            RequestHandler handler,
+                                            const RequestHandlerOptions& options)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QList<RequestHandlerEntry>& handlers = m_gatherHandlers[topic];
+    for (const RequestHandlerEntry& existing : std::as_const(handlers)) {
+        if (existing.handlerId == handlerId) {
+            qWarning() << "EventBus: Gather handler" << handlerId << "already registered for topic:" << topic;
+            return false;
+        }
+    }
+    handlers.append(makeHandlerEntry(topic, handlerId, std::move(handler), options));
+
+    qDebug() << "EventBus: Registered gather handler for" << topic << "by" << handlerId;
+    return true;
+}
+
+bool EventBusService::unregisterGatherHandler(const QString& topic, const QString& handlerId)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_gatherHandlers.find(topic);
+    if (it == m_gatherHandlers.end()) {
+        return false;
+    }
+
+    const bool removed = it->removeIf([&handlerId](const RequestHandlerEntry& entry) {
+        return entry.handlerId == handlerId;
+    }) > 0;
+    if (it->isEmpty()) {
+        m_gatherHandlers.erase(it);
+    }
+    return removed;
+}
+
+EventBusService::RequestHandlerEntry EventBusService::makeHandlerEntry(const QString& topic,
+                                                                      const QString& handlerId,
+                                                                      RequestHandler handler,
+                                                                      const RequestHandlerOptions& options)
+{
+    // Note: must be called with m_mutex held
+    RequestHandlerEntry entry;
+    entry.topic = deepCopy(topic);
+    entry.handlerId = deepCopy(handlerId);
+    entry.handler = std::move(handler);
+    entry.options = options;
+    entry.options.workerThread = deepCopy(options.workerThread);
+    if (options.target == DeliveryTarget::OwnerThread) {
+        entry.queue = m_ownerQueue;
+    } else if (options.target == DeliveryTarget::WorkerThread) {
+        entry.queue = workerQueue(entry.options.workerThread);
+    }
+    return entry;
+}
+
+bool EventBusService::unregisterHandler(const QString& topic)
+{
+    QMutexLocker locker(&m_mutex);
+    bool removed = m_requestHandlers.remove(topic) > 0;
+    if (removed) {
+        qDebug() << "EventBus: Unregistered request handler for" << topic;
+    }
+    return removed;
+}
+
+void EventBusService::unregisterAllHandlers(const QString& handlerId)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QStringList toRemove;
+    for (auto it = m_requestHandlers.constBegin(); it != m_requestHandlers.constEnd(); ++it) {
+        if (it->handlerId == handlerId) {
+            toRemove.append(it.key());
+        }
+    }
+
+    for (const QString& topic : toRemove) {
+        m_requestHandlers.remove(topic);
+    }
+
+    for (auto it = m_gatherHandlers.begin(); it != m_gatherHandlers.end();) {
+        it->removeIf([&handlerId](const RequestHandlerEntry& entry) {
+            return entry.handlerId == handlerId;
+        });
+        it = it->isEmpty() ? m_gatherHandlers.erase(it) : std::next(it);
+    }
+
+    if (!toRemove.isEmpty()) {
+        qDebug() << "EventBus: Unregistered all handlers for" << handlerId
+                 << "(" << toRemove.size() << "handlers)";
+    }
+}
+
+std::optional<QVariantMap> EventBusService::request(const QString& topic,
+                                                     const QVariantMap& data,
+                                                     const QString& senderId,
+                                                     int timeoutMs)
+{
+    RequestHandlerEntry entry;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_requestHandlers.find(topic);
+        if (it == m_requestHandlers.end()) {
+            qDebug() << "EventBus: No handler for request topic:" << topic;
+            return std::nullopt;
+        }
+        entry = *it;
+    }
+
+    Event event;
+    event.topic = topic;
+    event.senderId = senderId;
+    event.data = adoptPayloads(data);
+    event.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    if (runsInline(entry)) {
+        // Nothing to wait for, so timeoutMs can't apply to an inline handler
+        try {
+            return deepCopy(entry.handler(event));
+        } catch (const std::exception& e) {
+            qWarning() << "EventBus: Request handler threw exception:" << e.what();
+            return std::nullopt;
+        }
+    }
+
+    const PendingRequestPtr pending = dispatchRequest(entry, event, 0);
+
+    QMutexLocker locker(&pending->mutex);
+    const int waitMs = timeoutMs > 0 ? timeoutMs : kDefaultRequestTimeoutMs;
+    const QDeadlineTimer deadline(waitMs);
+    while (!pending->settled) {
+        if (!pending->settledCondition.wait(&pending->mutex, deadline)) {
+            break;
+        }
+    }
+
+    if (!pending->settled) {
+        // Still holding the lock, so a late reply can no longer slip in
+        pending->settled = true;
+        pending->promise.future().cancel();
+        pending->promise.finish();
+        qWarning() << "EventBus: Request timed out:" << topic << "after" << waitMs << "ms";
+    }
+    return pending->reply;
+}
+
+QFuture<QVariantMap> EventBusService::requestAsync(const QString& topic,
+                                                   const QVariantMap& data,
+                                                   const QString& senderId,
+                                                   int timeoutMs)
+{
+    RequestHandlerEntry entry;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_requestHandlers.find(topic);
+        if (it == m_requestHandlers.end()) {
+            qDebug() << "EventBus: No handler for request topic:" << topic;
+            QPromise<QVariantMap> promise;
+            promise.start();
+            promise.future().cancel();
+            promise.finish();
+            return promise.future();
+        }
+        entry = *it;
+    }
+
+    Event event;
+    event.topic = topic;
+    event.senderId = senderId;
+    event.data = adoptPayloads(data);
+    event.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    return dispatchRequest(entry, event, timeoutMs)->promise.future();
+}
+
+QFuture<Event> EventBusService::nextEvent(const QString& pattern, int timeoutMs,
+                                         const QString& subscriberId)
+{
+    auto pending = std::make_shared<PendingEvent>();
+    pending->promise.start();
+    QFuture<Event> future = pending->promise.future();
+
+    // Settles exactly once: with the first event, or canceled by the
+    // deadline or the caller
+    auto settle = [this, pending](const Event* event) {
+        QString subscriptionId;
+        {
+            QMutexLocker locker(&pending->mutex);
+            if (pending->settled) {
+                return;
+            }
+            pending->settled = true;
+            if (event && !pending->promise.isCanceled()) {
+                pending->promise.addResult(*event);
+            } else {
+                pending->promise.future().cancel();
+            }
+            pending->promise.finish();
+            subscriptionId = pending->subscriptionId;
+        }
+        if (!subscriptionId.isEmpty()) {
+            removeSubscription(subscriptionId, false);
+        }
+    };
+
+    // Inline on the publisher, so the wait ends even if the owner thread is busy
+    ExtendedSubscriptionOptions options;
+    options.target = DeliveryTarget::CallerThread;
+    options.receiveOwnEvents = true;
+    QString subscriptionId = addSubscription(pattern, subscriberId,
+        [settle](const Event& event) { settle(&event); }, options, false);
+    {
+        QMutexLocker locker(&pending->mutex);
+        if (!pending->settled) {
+            pending->subscriptionId = subscriptionId;
+            subscriptionId.clear();
+        }
+    }
+    if (!subscriptionId.isEmpty()) {
+        removeSubscription(subscriptionId, false);  // An event arrived before we stored the id
+    }
+
+    // A canceled future (or a destroyed FutureAwaiter) unsubscribes right
+    // away instead of with the next matching event. The watcher lives on
+    // the owner thread; one set on an already canceled future still fires.
+    QMetaObject::invokeMethod(this, [this, future, settle]() {
+        auto* watcher = new QFutureWatcher<Event>(this);
+        connect(watcher, &QFutureWatcherBase::canceled, this, [settle]() { settle(nullptr); });
+        connect(watcher, &QFutureWatcherBase::finished, watcher, &QObject::deleteLater);
+        watcher->setFuture(future);
+    });
+
+    if (timeoutMs > 0) {
+        QTimer::singleShot(timeoutMs, this, [settle]() { settle(nullptr); });
+    }
+    return future;
+}
+
+bool EventBusService::runsInline(const RequestHandlerEntry& entry) const
+{
+    // An executor blocked in request() would never get to run the handler,
+    // and a pool thread blocked on a pool handler might wait for itself once
+    // every pool thread does the same
+    return entry.options.target == DeliveryTarget::CallerThread
+        || (entry.queue ? entry.queue->context->thread() == QThread::currentThread()
+                        : t_inPoolDrain);
+}
+
+EventBusService::PendingRequestPtr EventBusService::dispatchRequest(const RequestHandlerEntry& entry,
+                                                                    const Event& event,
+                                                                    int timeoutMs)
+{
+    auto pending = std::make_shared<PendingRequest>();
+    pending->promise.start();
+
+    auto task = [pending, handler = entry.handler, event]() {
+        // Canceled (or timed out) while queued: don't bother the handler
+        if (pending->promise.isCanceled()) {
+            settleRequest(*pending, std::nullopt);
+            return;
+        }
+
+        std::optional<QVariantMap> reply;
+        try {
+            reply = deepCopy(handler(event));
+        } catch (const std::exception& e) {
+            qWarning() << "EventBus: Request handler threw exception:" << e.what();
+        }
+        settleRequest(*pending, std::move(reply));
+    };
+
+    execute(entry, std::move(task));
+
+    if (timeoutMs > 0) {
+        QTimer::singleShot(timeoutMs, this, [pending, topic = event.topic, timeoutMs]() {
+            if (settleRequest(*pending, std::nullopt)) {
+                qWarning() << "EventBus: Request timed out:" << topic << "after" << timeoutMs << "ms";
+            }
+        });
+    }
+
+    return pending;
+}
+
+QFuture<QVariantMap> EventBusService::gather(const QString& topic,
+                                             const QVariantMap& data,
+                                             const QString& senderId,
+                                             const GatherOptions& options)
+{
+    QList<RequestHandlerEntry> handlers;
+    {
+        QMutexLocker locker(&m_mutex);
+        handlers = m_gatherHandlers.value(topic);
+    }
+
+    Event event;
+    event.topic = topic;
+    event.senderId = senderId;
+    event.data = adoptPayloads(data);
+    event.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    auto pending = std::make_shared<PendingGather>();
+    pending->promise.start();
+    pending->outstanding = handlers.size();
+    pending->quorum = (options.quorum > 0 && options.quorum < handlers.size())
+        ? options.quorum : handlers.size();
+
+    if (handlers.isEmpty()) {
+        settleGather(*pending);
+        return pending->promise.future();
+    }
+
+    for (const RequestHandlerEntry& entry : std::as_const(handlers)) {
+        execute(entry, [pending, handler = entry.handler, handlerId = entry.handlerId, event]() {
+            std::optional<QVariantMap> reply;
+            if (!pending->promise.isCanceled()) {
+                try {
+                    reply = deepCopy(handler(event));
+                } catch (const std::exception& e) {
+                    qWarning() << "EventBus: Gather handler" << handlerId << "threw exception:" << e.what();
+                }
+            }
+
+            QMutexLocker locker(&pending->mutex);
+            if (pending->settled) {
+                return;  // Late responder: the caller has moved on
+            }
+            if (reply) {
+                pending->replies.insert(handlerId, *reply);
+            }
+            if (--pending->outstanding == 0 || pending->replies.size() >= pending->quorum) {
+                settleGather(*pending);
+            }
+        });
+    }
+
+    if (options.timeoutMs > 0) {
+        QTimer::singleShot(options.timeoutMs, this, [pending]() {
+            QMutexLocker locker(&pending->mutex);
+            if (!pending->settled) {
+                settleGather(*pending);
+            }
+        });
+    }
+
+    return pending->promise.future();
+}
+
+void EventBusService::execute(const RequestHandlerEntry& entry, std::function<void()> task)
+{
+    if (entry.queue) {
+        QMetaObject::invokeMethod(entry.queue->context, std::move(task), Qt::QueuedConnection);
+    } else {
+        m_pool.start([task = std::move(task)]() {
+            t_inPoolDrain = true;
+            task();
+            t_inPoolDrain = false;
+        });
+    }
+}
+
+void EventBusService::settleGather(PendingGather& pending)
+{
+    // Note: must be called with pending.mutex held (or before it is shared)
+    pending.settled = true;
+    pending.promise.addResult(pending.replies);
+    pending.promise.finish();
+}
+
+bool EventBusService::settleRequest(PendingRequest& pending, std::optional<QVariantMap> reply)
+{
+    QMutexLocker locker(&pending.mutex);
+    if (pending.settled) {
+        return false;
+    }
+
+    pending.settled = true;
+    if (reply) {
+        pending.promise.addResult(*reply);
+        pending.reply = std::move(reply);
+    } else {
+        pending.promise.future().cancel();
+    }
+    pending.promise.finish();
+    pending.settledCondition.wakeAll();
+    return true;
+}
+
+bool EventBusService::hasHandler(const QString& topic) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_requestHandlers.contains(topic);
+}
+
+EventBusService::TablePtr EventBusService::currentTable() const
+{
+    return m_table.load();
+}
+
+std::shared_ptr<EventBusService::SubscriptionTable> EventBusService::cloneTable() const
+{
+    // Note: must be called with m_mutex held
+    const TablePtr current = currentTable();
+
+    auto next = std::make_shared<SubscriptionTable>();
+    next->subscriptions = current->subscriptions;
+    next->subscriberIndex = current->subscriberIndex;
+    next->topicIndex = current->topicIndex;
+    next->conflation = current->conflation;
+    next->conflationIndex = current->conflationIndex;
+    next->retention = current->retention;
+    next->retentionIndex = current->retentionIndex;
+    next->sequencing = current->sequencing;
+    next->sequencingIndex = current->sequencingIndex;
+    next->generation = current->generation + 1;
+    return next;
+}
+
+void EventBusService::publishTable(std::shared_ptr<SubscriptionTable> table)
+{
+    // Note: must be called with m_mutex held
+    m_table.store(std::move(table));
+}
+
+EventBusService::PlanPtr EventBusService::deliveryPlanFor(const SubscriptionTable& table,
+                                                          const QString& topic) const
+{
+    {
+        QReadLocker locker(&table.cacheLock);
+        auto it = table.deliveryCache.constFind(topic);
+        if (it != table.deliveryCache.constEnd()) {
+            m_cacheHits.fetch_add(1, std::memory_order_relaxed);
+            if (!(*it)->referenced.load(std::memory_order_relaxed)) {
+                (*it)->referenced.store(true, std::memory_order_relaxed);
+            }
+            return *it;
+        }
+    }
+
+    m_cacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+    QList<SubscriptionPtr> matches = table.topicIndex.match(topic);
+
+    // Sort by priority (descending - higher priority first)
+    std::sort(matches.begin(), matches.end(),
+              [](const SubscriptionPtr& a, const SubscriptionPtr& b) {
+                  return a->options.priority > b->options.priority;
+              });
+
+    auto plan = std::make_shared<DeliveryPlan>();
+    plan->all = matches;
+
+    plan->retainDepth = retainDepth(table, topic);
+    if (!table.sequencingIndex.match(topic).isEmpty()) {
+        plan->sequence = sequenceCounter(topic);
+    }
+
+    const QList<QString> conflatedPatterns = table.conflationIndex.match(topic);
+    if (!conflatedPatterns.isEmpty()) {
+        plan->conflated = true;
+        plan->conflationKey = table.conflation.value(conflatedPatterns.first());
+    }
+
+    for (const SubscriptionPtr& sub : std::as_const(matches)) {
+        if (sub->options.target == DeliveryTarget::CallerThread) {
+            plan->callerThread.append(sub);
+        } else {
+            plan->queued.append(sub);
+        }
+    }
+
+    QWriteLocker locker(&table.cacheLock);
+    if (const auto it = table.deliveryCache.constFind(topic); it != table.deliveryCache.constEnd()) {
+        return *it;  // Another publisher built it meanwhile
+    }
+
+    if (table.deliveryClock.size() < kMaxDeliveryCacheEntries) {
+        table.deliveryClock.append(topic);
+    } else {
+        // Second chance: the hand clears the bit of plans hit since it last
+        // passed and evicts the first one without, within one revolution
+        for (;;) {
+            QString& slot = table.deliveryClock[table.clockHand];
+            table.clockHand = (table.clockHand + 1) % kMaxDeliveryCacheEntries;
+            const PlanPtr candidate = table.deliveryCache.value(slot);
+            if (candidate && candidate->referenced.exchange(false, std::memory_order_relaxed)) {
+                continue;
+            }
+            table.deliveryCache.remove(slot);
+            slot = topic;
+            break;
+        }
+    }
+    table.deliveryCache.insert(topic, plan);
+
+    return plan;
+}
+
+EventBusService::PlanPtr EventBusService::atomPlanFor(const SubscriptionTable& table, TopicId topic,
+                                                      const QString& name) const
+{
+    {
+        QReadLocker locker(&table.cacheLock);
+        if (topic < quint32(table.atomPlans.size()) && table.atomPlans.at(topic)) {
+            m_cacheHits.fetch_add(1, std::memory_order_relaxed);
+            return table.atomPlans.at(topic);
+        }
+    }
+
+    PlanPtr plan = deliveryPlanFor(table, name);
+
+    // Registered topics are a bounded set, so this is not capped
+    QWriteLocker locker(&table.cacheLock);
+    if (quint32(table.atomPlans.size()) <= topic) {
+        table.atomPlans.resize(topic + 1);
+    }
+    table.atomPlans[topic] = plan;
+    return plan;
+}
+
+EventBusService::TopicDataPtr EventBusService::topicData(const QString& topic, bool pin)
+{
+    {
+        QReadLocker locker(&m_statsLock);
+        auto it = m_topicStats.constFind(topic);
+        if (it != m_topicStats.constEnd() && (!pin || (*it)->pinned)) {
+            return *it;
+        }
+    }
+
+    // Untracked topics go to the sketch; one only gets exact stats once it
+    // is heavier than the lightest tracked topic (space-saving style)
+    const size_t hash = qHash(topic, kTopicSketchSeed);
+    const qint64 estimate = pin ? 0 : m_topicSketch.add(hash);
+    if (!pin && estimate <= m_admissionThreshold.load(std::memory_order_relaxed)) {
+        return {};
+    }
+
+    QWriteLocker locker(&m_statsLock);
+    auto it = m_topicStats.find(topic);
+    if (it != m_topicStats.end()) {
+        (*it)->pinned = (*it)->pinned || pin;
+        return *it;
+    }
+
+    if (m_topicStats.size() >= kMaxTrackedTopics) {
+        const TrackedTopic* victim = lightestTopic();
+        if (!pin && (!victim || victim->count >= estimate)) {
+            m_admissionThreshold.store(victim ? victim->count : std::numeric_limits<qint64>::max(),
+                                       std::memory_order_relaxed);  // was stale
+            return {};
+        }
+        if (victim) {
+            // Hand the evicted count back to the sketch so it can compete again
+            m_topicSketch.raise(qHash(victim->topic, kTopicSketchSeed),
+                                quint32(qMin<qint64>(victim->count, std::numeric_limits<quint32>::max())));
+            m_topicStats.remove(victim->topic);
+            std::pop_heap(m_evictionHeap.begin(), m_evictionHeap.end(), heavierTopic);
+            m_evictionHeap.pop_back();
+        }
+    }
+
+    auto data = std::make_shared<TopicData>();
+    data->pinned = pin;
+    // Seeded with the sketch's (over)estimate of what was published untracked
+    data->eventCount.store(qMax<qint64>(0, estimate - 1), std::memory_order_relaxed);
+    m_topicStats.insert(topic, data);
+    if (!pin) {
+        m_evictionHeap.push_back({data->eventCount.load(std::memory_order_relaxed), topic, data.get()});
+        std::push_heap(m_evictionHeap.begin(), m_evictionHeap.end(), heavierTopic);
+    }
+
+    updateAdmissionThreshold();
+    return data;
+}
+
+const EventBusService::TrackedTopic* EventBusService::lightestTopic()
+{
+    // Note: must be called with m_statsLock held for writing
+    //
+    // Counts only grow, so every key in the heap is at most its topic's
+    // count: once the top's key is current it is the lightest. Only topics
+    // published since they were last on top get re-sifted, not all 512.
+    // Bounded, in case the topic on top keeps being published meanwhile
+    for (size_t refreshed = 0; !m_evictionHeap.empty(); ++refreshed) {
+        TrackedTopic& top = m_evictionHeap.front();
+        if (top.data->pinned) {
+            // Pinned after it was tracked (see topicData), never evicted
+            std::pop_heap(m_evictionHeap.begin(), m_evictionHeap.end(), heavierTopic);
+            m_evictionHeap.pop_back();
+            continue;
+        }
+        const qint64 count = top.data->eventCount.load(std::memory_order_relaxed);
+        if (count == top.count || refreshed >= m_evictionHeap.size()) {
+            return &top;
+        }
+        std::pop_heap(m_evictionHeap.begin(), m_evictionHeap.end(), heavierTopic);
+        m_evictionHeap.back().count = count;
+        std::push_heap(m_evictionHeap.begin(), m_evictionHeap.end(), heavierTopic);
+    }
+    return nullptr;
+}
+
+void EventBusService::updateAdmissionThreshold()
+{
+    // Note: must be called with m_statsLock held for writing
+    if (m_topicStats.size() < kMaxTrackedTopics) {
+        m_admissionThreshold.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    const TrackedTopic* lightest = lightestTopic();
+    m_admissionThreshold.store(lightest ? lightest->count : std::numeric_limits<qint64>::max(),
+                               std::memory_order_relaxed);
+}
+
+QVariantMap EventBusService::topicMetrics(const TopicData& data, qint64 now) const
+{
+    QVariantMap result;
+    result["eventCount"] = data.eventCount.load(std::memory_order_relaxed);
+    result["lastEventTime"] = data.lastEventTime.load(std::memory_order_relaxed);
+    result["rates"] = data.rate.toVariantMap(now);
+    result["deliveryLatencyUs"] = data.deliveryLatency.toVariantMap();
+    result["handlerTimeUs"] = data.handlerTime.toVariantMap();
     return result;
 }
 
@@ -0,0 +1,501 @@
+#include "event_journal.h"
+#include "event_bus_service.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QThread>
+#include <QTimer>
+#include <QtEndian>
+#include <QDebug>
+
+#include <cstring>
+#include <utility>
+
+namespace mpf {
+
+namespace {
+
+constexpr char kMagic[4] = {'M', 'P', 'F', 'J'};
+constexpr quint16 kVersion = 1;
+constexpr qint64 kHeaderSize = 16;
+constexpr quint8 kFlagSynchronous = 0x01;
+constexpr quint16 kSegmentRunStart = 0x0001;
+
+// Backoff between attempts to create a segment after one failed
+constexpr int kMinRetryMs = 1000;
+constexpr int kMaxRetryMs = 60000;
+
+// Replayed events per event loop turn, so a replay never starves the loop
+constexpr int kMaxReplayPerStep = 1024;
+
+template <typename T>
+void appendLittleEndian(QByteArray& out, T value)
+{
+    const T le = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+void appendString(QByteArray& out, const QString& text)
+{
+    QByteArray utf8 = text.toUtf8();
+    utf8.truncate(0xffff);
+    appendLittleEndian<quint16>(out, quint16(utf8.size()));
+    out.append(utf8);
+}
+
+QByteArray encodeRecord(const Event& event, qint64 monotonicMicros, bool synchronous)
+{
+    const QByteArray data = QCborValue::fromVariant(event.data).toCbor();
+
+    QByteArray out;
+    out.reserve(4 + 1 + 16 + 4 + event.topic.size() + event.senderId.size() + 4 + data.size());
+    appendLittleEndian<quint32>(out, 0);  // size, patched below
+    appendLittleEndian<quint8>(out, synchronous ? kFlagSynchronous : 0);
+    appendLittleEndian<qint64>(out, event.timestamp);
+    appendLittleEndian<qint64>(out, monotonicMicros);
+    appendString(out, event.topic);
+    appendString(out, event.senderId);
+    appendLittleEndian<quint32>(out, quint32(data.size()));
+    out.append(data);
+
+    qToLittleEndian<quint32>(quint32(out.size() - 4), out.data());
+    return out;
+}
+
+// Bounds-checked reads from one record
+class RecordCursor
+{
+public:
+    RecordCursor(const uchar* data, qint64 size) : m_data(data), m_size(size) {}
+
+    template <typename T>
+    bool read(T& value)
+    {
+        if (m_offset + qint64(sizeof(T)) > m_size) {
+            return false;
+        }
+        value = qFromLittleEndian<T>(m_data + m_offset);
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    template <typename Length>
+    bool readBytes(QByteArray& bytes)
+    {
+        Length length = 0;
+        if (!read(length) || m_offset + qint64(length) > m_size) {
+            return false;
+        }
+        bytes = QByteArray(reinterpret_cast<const char*>(m_data + m_offset), length);
+        m_offset += length;
+        return true;
+    }
+
+private:
+    const uchar* m_data;
+    qint64 m_size;
+    qint64 m_offset = 0;
+};
+
+std::optional<JournalRecord> decodeRecord(const uchar* data, qint64 size)
+{
+    RecordCursor cursor(data, size);
+    JournalRecord record;
+    quint8 flags = 0;
+    QByteArray topic;
+    QByteArray sender;
+    QByteArray payload;
+
+    if (!cursor.read(flags) || !cursor.read(record.event.timestamp)
+        || !cursor.read(record.monotonicMicros) || !cursor.readBytes<quint16>(topic)
+        || !cursor.readBytes<quint16>(sender) || !cursor.readBytes<quint32>(payload)) {
+        return std::nullopt;
+    }
+
+    record.synchronous = flags & kFlagSynchronous;
+    record.event.topic = QString::fromUtf8(topic);
+    record.event.senderId = QString::fromUtf8(sender);
+    record.event.data = QCborValue::fromCbor(payload).toMap().toVariantMap();
+    return record;
+}
+
+} // namespace
+
+// =============================================================================
+// EventJournal
+// =============================================================================
+
+EventJournal::EventJournal(const QString& directory, const JournalOptions& options)
+    : m_directory(directory)
+    , m_options(options)
+{
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "EventBus: Cannot create journal directory" << directory;
+        return;
+    }
+
+    // Continue the numbering of an existing journal instead of overwriting it
+    const QStringList existing = segmentFiles(directory);
+    if (!existing.isEmpty()) {
+        m_segmentIndex = QFileInfo(existing.last()).baseName().mid(7).toInt() + 1;
+    }
+
+    m_open = openSegment(0);
+    if (!m_open) {
+        return;
+    }
+
+    m_writer = QThread::create([this]() { run(); });
+    m_writer->setObjectName("EventBus:journal");
+    m_writer->start();
+    qDebug() << "EventBus: Recording journal to" << directory;
+}
+
+EventJournal::~EventJournal()
+{
+    if (m_writer) {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stopping = true;
+            m_wake.wakeAll();
+        }
+        m_writer->wait();
+        delete m_writer;
+    }
+    closeSegment();
+}
+
+void EventJournal::record(std::shared_ptr<const Event> event, qint64 monotonicMicros, bool synchronous)
+{
+    if (!m_open) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_queue.size() >= m_options.queueCapacity) {
+        ++m_dropped;
+        if (!m_warnedDrop) {
+            m_warnedDrop = true;
+            qWarning() << "EventBus: Journal writer is behind, dropping records";
+        }
+        return;
+    }
+
+    m_queue.enqueue(Pending{std::move(event), monotonicMicros, synchronous});
+    ++m_enqueued;
+    if (m_queue.size() == 1) {
+        m_wake.wakeOne();
+    }
+}
+
+void EventJournal::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 target = m_enqueued;
+    while (m_open && m_written + m_failed < target) {
+        m_drained.wait(&m_mutex);
+    }
+}
+
+QVariantMap EventJournal::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap result;
+    result["recorded"] = m_written;
+    result["dropped"] = m_dropped + m_failed;
+    result["segments"] = m_segments.load();
+    result["bytes"] = m_bytes.load();
+    return result;
+}
+
+QStringList EventJournal::segmentFiles(const QString& directory)
+{
+    const QDir dir(directory);
+    QStringList files;
+    for (const QString& name : dir.entryList({"events-*.mpfj"}, QDir::Files, QDir::Name)) {
+        files.append(dir.filePath(name));
+    }
+    return files;
+}
+
+void EventJournal::run()
+{
+    QQueue<Pending> batch;
+    for (;;) {
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_queue.isEmpty() && !m_stopping) {
+                m_wake.wait(&m_mutex);
+            }
+            if (m_queue.isEmpty()) {
+                break;  // Stopping, and everything is written
+            }
+            batch.swap(m_queue);
+        }
+
+        // Encoding and copying happen outside the lock
+        qint64 failed = 0;
+        for (const Pending& pending : std::as_const(batch)) {
+            if (!write(pending)) {
+                ++failed;
+            }
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_written += batch.size() - failed;
+        m_failed += failed;
+        m_drained.wakeAll();
+        batch.clear();
+    }
+}
+
+bool EventJournal::write(const Pending& pending)
+{
+    // No segment since the last failure: drop without retrying every record
+    if (!m_map && !m_retryAt.hasExpired()) {
+        return false;
+    }
+
+    const QByteArray bytes = encodeRecord(*pending.event, pending.monotonicMicros, pending.synchronous);
+
+    // Keep room for the end marker
+    if (!m_map || m_offset + bytes.size() + 4 > m_segmentSize) {
+        closeSegment();
+        if (!openSegment(bytes.size())) {
+            if (m_retryMs == 0) {
+                qWarning() << "EventBus: Journal is dropping records until a segment can be created";
+            }
+            m_retryMs = m_retryMs == 0 ? kMinRetryMs : qMin(m_retryMs * 2, kMaxRetryMs);
+            m_retryAt.setRemainingTime(m_retryMs);
+            return false;
+        }
+        if (m_retryMs != 0) {
+            qDebug() << "EventBus: Journal is recording again";
+            m_retryMs = 0;
+        }
+    }
+
+    std::memcpy(m_map + m_offset, bytes.constData(), size_t(bytes.size()));
+    m_offset += bytes.size();
+    m_bytes.fetch_add(bytes.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool EventJournal::openSegment(qint64 minimumSize)
+{
+    const qint64 size = qMax(m_options.segmentBytes, kHeaderSize + minimumSize + 4);
+    const QString name = QString("events-%1.mpfj").arg(m_segmentIndex, 6, 10, QLatin1Char('0'));
+
+    // A failed attempt leaves no file behind and keeps the index for the retry
+    m_segment.setFileName(QDir(m_directory).filePath(name));
+    if (!m_segment.open(QIODevice::ReadWrite | QIODevice::Truncate) || !m_segment.resize(size)) {
+        qWarning() << "EventBus: Cannot create journal segment" << m_segment.fileName()
+                   << m_segment.errorString();
+        m_segment.remove();
+        return false;
+    }
+
+    m_map = m_segment.map(0, size);
+    if (!m_map) {
+        qWarning() << "EventBus: Cannot map journal segment" << m_segment.fileName()
+                   << m_segment.errorString();
+        m_segment.remove();
+        return false;
+    }
+
+    // Monotonic times restart with each process, so readers pace runs separately
+    const quint16 flags = m_segments.load(std::memory_order_relaxed) == 0 ? kSegmentRunStart : 0;
+
+    // Resized files read back as zeros, so the unwritten tail is an end marker
+    std::memcpy(m_map, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint16>(kVersion, m_map + 4);
+    qToLittleEndian<quint16>(flags, m_map + 6);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), m_map + 8);
+
+    ++m_segmentIndex;
+    m_segmentSize = size;
+    m_offset = kHeaderSize;
+    m_segments.fetch_add(1, std::memory_order_relaxed);
+    pruneSegments();
+    return true;
+}
+
+void EventJournal::closeSegment()
+{
+    if (!m_map) {
+        return;
+    }
+
+    m_segment.unmap(m_map);
+    m_map = nullptr;
+    m_segment.resize(m_offset);  // Drop the unused tail
+    m_segment.close();
+}
+
+void EventJournal::pruneSegments()
+{
+    if (m_options.maxSegments <= 0) {
+        return;
+    }
+
+    QStringList files = segmentFiles(m_directory);
+    while (files.size() > m_options.maxSegments) {
+        QFile::remove(files.takeFirst());
+    }
+}
+
+// =============================================================================
+// EventJournalReader
+// =============================================================================
+
+EventJournalReader::EventJournalReader(const QString& directory)
+    : m_files(EventJournal::segmentFiles(directory))
+{
+}
+
+EventJournalReader::~EventJournalReader()
+{
+    closeSegment();
+}
+
+std::optional<JournalRecord> EventJournalReader::next()
+{
+    for (;;) {
+        if (!m_map && !openNextSegment()) {
+            return std::nullopt;
+        }
+
+        if (m_offset + 4 <= m_size) {
+            const quint32 size = qFromLittleEndian<quint32>(m_map + m_offset);
+            if (size > 0 && m_offset + 4 + size <= m_size) {
+                std::optional<JournalRecord> record = decodeRecord(m_map + m_offset + 4, size);
+                m_offset += 4 + size;
+                if (record) {
+                    record->runStart = std::exchange(m_runStart, false);
+                    return record;
+                }
+                qWarning() << "EventBus: Skipping corrupt journal record in" << m_file.fileName();
+                continue;
+            }
+        }
+
+        // End marker, a record cut short by a crash, or end of file
+        closeSegment();
+    }
+}
+
+bool EventJournalReader::openNextSegment()
+{
+    while (m_fileIndex < m_files.size()) {
+        m_file.setFileName(m_files.at(m_fileIndex++));
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            qWarning() << "EventBus: Cannot open journal segment" << m_file.fileName();
+            continue;
+        }
+
+        m_size = m_file.size();
+        m_map = m_size >= kHeaderSize ? m_file.map(0, m_size) : nullptr;
+        if (!m_map || std::memcmp(m_map, kMagic, sizeof(kMagic)) != 0
+            || qFromLittleEndian<quint16>(m_map + 4) != kVersion) {
+            qWarning() << "EventBus: Not a journal segment:" << m_file.fileName();
+            closeSegment();
+            continue;
+        }
+
+        m_offset = kHeaderSize;
+        m_runStart = qFromLittleEndian<quint16>(m_map + 6) & kSegmentRunStart;
+        return true;
+    }
+    return false;
+}
+
+void EventJournalReader::closeSegment()
+{
+    if (m_map) {
+        m_file.unmap(const_cast<uchar*>(m_map));
+        m_map = nullptr;
+    }
+    m_file.close();
+}
+
+// =============================================================================
+// JournalReplayer
+// =============================================================================
+
+JournalReplayer::JournalReplayer(EventBusService* bus, const QString& directory, QObject* parent)
+    : QObject(parent)
+    , m_bus(bus)
+    , m_reader(directory)
+{
+}
+
+JournalReplayer::~JournalReplayer() = default;
+
+void JournalReplayer::start()
+{
+    if (m_running) {
+        return;
+    }
+
+    m_running = true;
+    m_next = m_reader.next();
+    m_runMicros = m_next ? m_next->monotonicMicros : 0;
+    m_runElapsed = 0;
+    m_clock.start();
+    QMetaObject::invokeMethod(this, &JournalReplayer::step, Qt::QueuedConnection);
+}
+
+void JournalReplayer::stop()
+{
+    m_running = false;
+}
+
+void JournalReplayer::step()
+{
+    if (!m_running) {
+        return;
+    }
+
+    const qint64 elapsed = m_clock.nsecsElapsed() / 1000;
+    int published = 0;
+
+    while (m_next) {
+        if (published == kMaxReplayPerStep) {
+            QMetaObject::invokeMethod(this, &JournalReplayer::step, Qt::QueuedConnection);
+            return;
+        }
+
+        if (m_speed > 0) {
+            const qint64 due = m_runElapsed + qint64((m_next->monotonicMicros - m_runMicros) / m_speed);
+            if (due > elapsed) {
+                QTimer::singleShot(int((due - elapsed + 999) / 1000), Qt::PreciseTimer,
+                                   this, &JournalReplayer::step);
+                return;
+            }
+        }
+
+        const Event& event = m_next->event;
+        if (m_next->synchronous) {
+            m_bus->publishSync(event.topic, event.data, event.senderId);
+        } else {
+            m_bus->publish(event.topic, event.data, event.senderId);
+        }
+        ++m_replayed;
+        ++published;
+        m_next = m_reader.next();
+        if (m_next && m_next->runStart) {
+            // A later run: its clock is unrelated, continue right away from here
+            m_runMicros = m_next->monotonicMicros;
+            m_runElapsed = m_clock.nsecsElapsed() / 1000;
+        }
+    }
+
+    m_running = false;
+    emit finished();
+}
+
+} // namespace mpf
@@ -0,0 +1,263 @@
+#include "event_subscription.h"
+#include "event_bus_service.h"
+
+#include <QGuiApplication>
+#include <QQmlEngine>
+#include <QQuickWindow>
+#include <QTimer>
+#include <QDebug>
+
+#include <utility>
+
+namespace mpf {
+
+namespace {
+
+// Events kept per element between frames; older ones are dropped beyond this
+constexpr int kMaxFrameEvents = 10000;
+
+// Used when no window is rendering (hidden, minimized, or none at all)
+constexpr int kFallbackFrameMs = 16;
+
+// Longest wait for a requested frame; an exposed window may still never
+// swap one (nothing to render, occluded, a stalled render loop)
+constexpr int kMaxFrameWaitMs = 100;
+
+/**
+ * Hands buffered PerFrame events to QML right after a frame was swapped.
+ *
+ * A waiting element asks the window for a frame, so events still arrive
+ * when nothing else on screen changes, and a timer bounds the wait for that
+ * frame. Elements are flushed in the order they first got an event since
+ * the previous frame.
+ */
+class FrameClock : public QObject
+{
+public:
+    static FrameClock* instance()
+    {
+        static FrameClock* clock = new FrameClock(qApp);
+        return clock;
+    }
+
+    void request(EventSubscription* subscription)
+    {
+        m_waiting.append(subscription);
+        if (m_waiting.size() > 1) {
+            return;
+        }
+
+        QQuickWindow* window = renderingWindow();
+        if (window) {
+            window->update();
+        }
+        m_fallback.start(window ? kMaxFrameWaitMs : kFallbackFrameMs);
+    }
+
+private:
+    explicit FrameClock(QObject* parent) : QObject(parent)
+    {
+        m_fallback.setSingleShot(true);
+        connect(&m_fallback, &QTimer::timeout, this, &FrameClock::tick);
+    }
+
+    QQuickWindow* renderingWindow()
+    {
+        if (!m_window || !m_window->isExposed()) {
+            m_window.clear();
+            const QWindowList windows = QGuiApplication::topLevelWindows();
+            for (QWindow* candidate : windows) {
+                auto* window = qobject_cast<QQuickWindow*>(candidate);
+                if (window && window->isExposed()) {
+                    m_window = window;
+                    // Emitted on the render thread with the threaded loop; queued to us
+                    connect(window, &QQuickWindow::frameSwapped, this, &FrameClock::tick,
+                            Qt::UniqueConnection);
+                    break;
+                }
+            }
+        }
+        return m_window;
+    }
+
+    void tick()
+    {
+        // Handlers may buffer new events; those request the next frame and
+        // rearm the timer, each tick again, until nothing is left waiting
+        m_fallback.stop();
+        const QList<QPointer<EventSubscription>> waiting = std::exchange(m_waiting, {});
+        for (const QPointer<EventSubscription>& subscription : waiting) {
+            if (subscription) {
+                subscription->flushFrame();
+            }
+        }
+    }
+
+    QPointer<QQuickWindow> m_window;
+    QTimer m_fallback;
+    QList<QPointer<EventSubscription>> m_waiting;
+};
+
+} // namespace
+
+QPointer<EventBusService> EventSubscription::s_bus;
+
+EventSubscription::EventSubscription(QObject* parent)
+    : QObject(parent)
+{
+}
+
+EventSubscription::~EventSubscription()
+{
+    unsubscribe();
+}
+
+void EventSubscription::setBus(EventBusService* bus)
+{
+    s_bus = bus;
+}
+
+void EventSubscription::registerType()
+{
+    qmlRegisterType<EventSubscription>("MPF.Events", 1, 0, "EventSubscription");
+}
+
+void EventSubscription::setPattern(const QString& pattern)
+{
+    if (m_pattern == pattern) {
+        return;
+    }
+    m_pattern = pattern;
+    emit patternChanged();
+    resubscribe();
+}
+
+void EventSubscription::setSubscriberId(const QString& subscriberId)
+{
+    if (m_subscriberId == subscriberId) {
+        return;
+    }
+    m_subscriberId = subscriberId;
+    emit subscriberIdChanged();
+    resubscribe();
+}
+
+void EventSubscription::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled) {
+        return;
+    }
+    m_enabled = enabled;
+    emit enabledChanged();
+    resubscribe();
+}
+
+void EventSubscription::setReceiveOwnEvents(bool receive)
+{
+    if (m_receiveOwnEvents == receive) {
+        return;
+    }
+    m_receiveOwnEvents = receive;
+    emit receiveOwnEventsChanged();
+    resubscribe();
+}
+
+void EventSubscription::setFilter(const QVariantMap& filter)
+{
+    if (m_filter == filter) {
+        return;
+    }
+    m_filter = filter;
+    emit filterChanged();
+    resubscribe();
+}
+
+void EventSubscription::componentComplete()
+{
+    m_complete = true;
+    resubscribe();
+}
+
+void EventSubscription::resubscribe()
+{
+    // Bindings set several properties during creation; subscribe once, at the end
+    if (!m_complete) {
+        return;
+    }
+
+    const bool wasActive = isActive();
+    unsubscribe();
+
+    if (m_enabled && !m_pattern.isEmpty()) {
+        if (!s_bus) {
+            qWarning() << "EventBus: EventSubscription for" << m_pattern << "has no bus";
+        } else {
+            ExtendedSubscriptionOptions options;
+            options.receiveOwnEvents = m_receiveOwnEvents;
+            options.filter = PayloadFilter::fromVariantMap(m_filter);
+
+            // Queued events may still arrive after this element is gone
+            QPointer<EventSubscription> self(this);
+            m_subscriptionId = s_bus->subscribe(m_pattern, m_subscriberId, [self](const Event& event) {
+                if (self) {
+                    self->deliver(event);
+                }
+            }, options);
+        }
+    }
+
+    if (wasActive != isActive()) {
+        emit activeChanged();
+    }
+}
+
+void EventSubscription::setDelivery(Delivery delivery)
+{
+    if (m_delivery == delivery) {
+        return;
+    }
+    flushFrame();
+    m_delivery = delivery;
+    emit deliveryChanged();
+}
+
+void EventSubscription::deliver(const Event& event)
+{
+    if (m_delivery == PerEvent) {
+        emit received(event.topic, event.data, event.senderId);
+        return;
+    }
+
+    if (m_frameEvents.size() >= kMaxFrameEvents) {
+        m_frameEvents.removeFirst();
+    }
+
+    QVariantMap entry;
+    entry["topic"] = event.topic;
+    entry["data"] = event.data;
+    entry["senderId"] = event.senderId;
+    entry["timestamp"] = event.timestamp;
+    m_frameEvents.append(entry);
+
+    if (m_frameEvents.size() == 1) {
+        FrameClock::instance()->request(this);
+    }
+}
+
+void EventSubscription::flushFrame()
+{
+    if (m_frameEvents.isEmpty()) {
+        return;
+    }
+    emit receivedBatch(std::exchange(m_frameEvents, {}));
+}
+
+void EventSubscription::unsubscribe()
+{
+    if (isActive() && s_bus) {
+        s_bus->unsubscribe(m_subscriptionId);
+    }
+    m_subscriptionId.clear();
+}
+
+} // namespace mpf
@@ -1,5 +1,7 @@
 #include "qml_context.h"
 #include "service_registry.h"
+#include "event_bus_service.h"
+#include "event_subscription.h"
 #include <mpf/version.h>
 #include <mpf/interfaces/inavigation.h>
 #include <mpf/interfaces/isettings.h>
@@ -31,6 +33,10 @@ void QmlContext::setup(QQmlApplicationEngine* engine)
     engine->rootContext()->setContextProperty("Theme", theme());
     engine->rootContext()->setContextProperty("AppMenu", appMenu());
     engine->rootContext()->setContextProperty("EventBus", eventBus());
+
+    // Topic-filtered subscriptions, instead of filtering eventPublished in JS
+    EventSubscription::setBus(qobject_cast<EventBusService*>(eventBus()));
+    EventSubscription::registerType();
 }
 
 QString QmlContext::version() const
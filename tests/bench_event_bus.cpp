@@ -0,0 +1,100 @@
+#include <QTest>
+#include <QCoreApplication>
+#include <QThread>
+
+#include "event_bus_service.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using namespace mpf;
+
+/**
+ * Publish throughput benchmarks (not part of CTest).
+ *
+ * Run with e.g. `./bench_event_bus -iterations 5` and compare the per-row
+ * wall times: with contention-free publishing the time for a fixed amount
+ * of work per thread should stay flat as the thread count grows, up to the
+ * number of cores.
+ */
+class BenchEventBus : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void benchPublishSyncThreads_data();
+    void benchPublishSyncThreads();
+
+private:
+    EventBusService* m_bus = nullptr;
+};
+
+void BenchEventBus::init()
+{
+    m_bus = new EventBusService(this);
+}
+
+void BenchEventBus::cleanup()
+{
+    delete m_bus;
+    m_bus = nullptr;
+}
+
+void BenchEventBus::benchPublishSyncThreads_data()
+{
+    QTest::addColumn<int>("threads");
+
+    const int cores = qMax(1, QThread::idealThreadCount());
+    for (int threads = 1; threads < cores; threads *= 2) {
+        QTest::newRow(qPrintable(QString("threads=%1").arg(threads))) << threads;
+    }
+    QTest::newRow(qPrintable(QString("threads=%1").arg(cores))) << cores;
+}
+
+void BenchEventBus::benchPublishSyncThreads()
+{
+    QFETCH(int, threads);
+
+    constexpr int kPublishesPerThread = 20000;
+    constexpr int kSubscriptions = 2000;
+
+    std::atomic<qint64> delivered{0};
+    SubscriptionOptions sync;
+    sync.async = false;
+
+    // A realistic mix: many unrelated subscriptions plus a few that match
+    for (int i = 0; i < kSubscriptions; ++i) {
+        m_bus->subscribe(QString("noise/%1/*").arg(i), "noise", [](const Event&) {}, sync);
+    }
+    m_bus->subscribe("bench/*", "wildcard",
+        [&delivered](const Event&) { delivered.fetch_add(1, std::memory_order_relaxed); }, sync);
+    m_bus->subscribe("bench/**", "deep",
+        [&delivered](const Event&) { delivered.fetch_add(1, std::memory_order_relaxed); }, sync);
+
+    QBENCHMARK {
+        std::vector<std::unique_ptr<QThread>> workers;
+        for (int t = 0; t < threads; ++t) {
+            const QString topic = QString("bench/%1").arg(t);
+            workers.emplace_back(QThread::create([this, topic]() {
+                for (int i = 0; i < kPublishesPerThread; ++i) {
+                    m_bus->publishSync(topic, {}, "bench");
+                }
+            }));
+        }
+        for (auto& worker : workers) {
+            worker->start();
+        }
+        for (auto& worker : workers) {
+            worker->wait();
+        }
+    }
+
+    QVERIFY(delivered.load() > 0);
+}
+
+QTEST_MAIN(BenchEventBus)
+#include "bench_event_bus.moc"
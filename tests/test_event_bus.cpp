@@ -1,7 +1,18 @@
 #include <QTest>
 #include <QCoreApplication>
-
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSemaphore>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+
+#include "event_bus_bridge.h"
+#include "event_bus_coroutines.h"
 #include "event_bus_service.h"
+#include "event_journal.h"
 
 using namespace mpf;
 
@@ -21,6 +32,10 @@ private slots:
     void testUnsubscribeAll();
     void testPublishSync();
     void testPublishAsync();
+    void testPublishAsyncBatchOrder();
+    void testPublishBatch();
+    void testEventPublishedOnlyWhenConnected();
+    void testEventPublishedUnbounded();
     void testNullHandlerRejected();
 
     // Wildcard matching
@@ -28,16 +43,49 @@ private slots:
     void testDoubleWildcard();
     void testMixedWildcards();
     void testMatchesTopic();
+    void testWildcardInsideSegment();
+    void testOverlappingDoubleWildcards();
+    void testUnsubscribeUpdatesIndex();
 
     // Options
     void testPriority();
     void testReceiveOwnEvents();
+    void testPayloadFilter();
+    void testInternedPublish();
+    void testSharedPayload();
+
+    // Delivery targets
+    void testCallerThreadTarget();
+    void testWorkerThreadTarget();
+    void testPoolTargetPreservesOrder();
+    void testPublishSyncKeepsTarget();
+    void testPriorityLanes();
+
+    // Mailboxes
+    void testMailboxDropOldest();
+    void testMailboxDropNewest();
+    void testMailboxCoalesceByKey();
+    void testMailboxBlock();
+    void testSubscriptionConflation();
+    void testTopicConflation();
+    void testThrottleDebounce();
+    void testPublishSyncThrottled();
+    void testRetainedReplay();
+    void testTopicSequencing();
+    void testSequencingIgnoresRejected();
 
     // Query
     void testSubscriberCount();
     void testActiveTopics();
     void testTopicStats();
     void testSubscriptionsFor();
+    void testDeliveryCache();
+    void testLatencyHistogram();
+    void testTopicMetrics();
+    void testBoundedTopicStats();
+    void testTopicAdmissionEvictsLightest();
+    void testSlowHandlerWatchdog();
+    void testDemotionKeepsOrder();
 
     // Request/Response
     void testRegisterHandler();
@@ -49,6 +97,19 @@ private slots:
     void testRequestHandlerException();
     void testDuplicateHandler();
     void testRequestFromQml();
+    void testRequestAsync();
+    void testRequestTimeout();
+    void testGather();
+    void testNextEvent();
+
+    // Journal
+    void testJournalRoundTrip();
+    void testJournalReplay();
+    void testJournalReplaySkipsGapBetweenRuns();
+    void testJournalSegmentFailure();
+
+    // Bridge
+    void testBridge();
 
     // Edge cases
     void testMultipleSubscribers();
@@ -148,6 +209,104 @@ void TestEventBus::testPublishAsync()
     QCOMPARE(received[0].data["key"].toString(), QString("val"));
 }
 
+void TestEventBus::testPublishAsyncBatchOrder()
+{
+    QStringList order;
+    int signals_ = 0;
+    connect(m_bus, &EventBusService::eventPublished, this,
+            [&signals_](const QString&, const QVariantMap&, const QString&) { signals_++; });
+
+    SubscriptionOptions low;
+    low.priority = 1;
+    m_bus->subscribe("batch", "low", [&order](const Event& e) {
+        order.append("low:" + e.data["n"].toString());
+    }, low);
+
+    SubscriptionOptions high;
+    high.priority = 10;
+    m_bus->subscribe("batch", "high", [&order](const Event& e) {
+        order.append("high:" + e.data["n"].toString());
+    }, high);
+
+    QCOMPARE(m_bus->publish("batch", {{"n", 1}}, "sender"), 2);
+    QCOMPARE(m_bus->publish("batch", {{"n", 2}}, "sender"), 2);
+    QVERIFY(order.isEmpty());
+
+    QCoreApplication::processEvents();
+    QCOMPARE(order, QStringList({"high:1", "low:1", "high:2", "low:2"}));
+    QCOMPARE(signals_, 2);
+}
+
+void TestEventBus::testPublishBatch()
+{
+    QStringList all;
+    QStringList onlyA;
+    int signals_ = 0;
+    connect(m_bus, &EventBusService::eventPublished, this,
+            [&signals_](const QString&, const QVariantMap&, const QString&) { signals_++; });
+
+    const QString allId = m_bus->subscribe("import/*", "all", [&all](const Event& e) {
+        all.append(e.topic.section('/', 1) + e.data["n"].toString());
+    });
+    m_bus->subscribe("import/a", "a", [&onlyA](const Event& e) {
+        onlyA.append(e.data["n"].toString());
+    });
+
+    QList<Event> events;
+    for (int n = 0; n < 6; ++n) {
+        Event event;
+        event.topic = n % 2 == 0 ? "import/a" : "import/b";
+        event.senderId = "importer";
+        event.data = {{"n", n}};
+        events.append(event);
+    }
+
+    QCOMPARE(m_bus->publishBatch(events), 9);
+    QVERIFY(all.isEmpty());
+
+    QCoreApplication::processEvents();
+    QCOMPARE(all, QStringList({"a0", "b1", "a2", "b3", "a4", "b5"}));
+    QCOMPARE(onlyA, QStringList({"0", "2", "4"}));
+    QCOMPARE(signals_, 6);
+    QCOMPARE(m_bus->subscriptionStats(allId)["delivered"].toLongLong(), 6LL);
+    QCOMPARE(m_bus->topicStats("import/b").eventCount, qint64(3));
+}
+
+void TestEventBus::testEventPublishedOnlyWhenConnected()
+{
+    // Nothing connected: the event is not even queued for the signal
+    m_bus->publish("quiet", {}, "sender");
+
+    QStringList topics;
+    auto connection = connect(m_bus, &EventBusService::eventPublished, this,
+        [&topics](const QString& topic, const QVariantMap&, const QString&) { topics.append(topic); });
+    QCoreApplication::processEvents();
+    QVERIFY(topics.isEmpty());
+
+    m_bus->publish("heard", {}, "sender");
+    m_bus->publishSync("heard/sync", {}, "sender");
+    QCoreApplication::processEvents();
+    QCOMPARE(topics, QStringList({"heard/sync", "heard"}));
+
+    disconnect(connection);
+    m_bus->publishSync("quiet/sync", {}, "sender");
+    QCOMPARE(topics.size(), 2);
+}
+
+void TestEventBus::testEventPublishedUnbounded()
+{
+    int signals_ = 0;
+    connect(m_bus, &EventBusService::eventPublished, this,
+            [&signals_](const QString&, const QVariantMap&, const QString&) { signals_++; });
+
+    // Well past the default mailbox capacity of 1024
+    for (int i = 0; i < 3000; ++i) {
+        m_bus->publish("flood", {{"i", i}}, "sender");
+    }
+    QCoreApplication::processEvents();
+    QCOMPARE(signals_, 3000);
+}
+
 void TestEventBus::testNullHandlerRejected()
 {
     QString subId = m_bus->subscribe("test", "plugin-a", IEventBus::EventHandler{});
@@ -196,6 +355,50 @@ void TestEventBus::testMatchesTopic()
     QVERIFY(!m_bus->matchesTopic("orders", "orders/*"));
 }
 
+void TestEventBus::testWildcardInsideSegment()
+{
+    // Not a pure segment pattern: handled by the regex fallback
+    m_bus->subscribe("ord*/created", "plugin-a", [](const Event&) {});
+
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 1);
+    QCOMPARE(m_bus->subscriberCount("ordinals/created"), 1);
+    QCOMPARE(m_bus->subscriberCount("products/created"), 0);
+}
+
+void TestEventBus::testOverlappingDoubleWildcards()
+{
+    int received = 0;
+    SubscriptionOptions sync;
+    sync.async = false;
+    m_bus->subscribe("**/**", "plugin-a", [&received](const Event&) { received++; }, sync);
+    m_bus->subscribe("a/**/d", "plugin-b", [](const Event&) {}, sync);
+
+    // "a/b/c/d" can be split several ways; each subscription still counts once
+    QCOMPARE(m_bus->subscriberCount("a/b/c/d"), 2);
+    QCOMPARE(m_bus->subscriberCount("a/d"), 1);
+    QCOMPARE(m_bus->subscriberCount("single"), 0);
+
+    m_bus->publishSync("a/b/c/d", {}, "sender");
+    QCOMPARE(received, 1);
+}
+
+void TestEventBus::testUnsubscribeUpdatesIndex()
+{
+    QString s1 = m_bus->subscribe("orders/*", "plugin-a", [](const Event&) {});
+    QString s2 = m_bus->subscribe("orders/*", "plugin-b", [](const Event&) {});
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 2);
+
+    m_bus->unsubscribe(s1);
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 1);
+
+    m_bus->unsubscribe(s2);
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 0);
+
+    // Pruned branches are rebuilt on demand
+    m_bus->subscribe("orders/*", "plugin-c", [](const Event&) {});
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 1);
+}
+
 // =============================================================================
 // Options
 // =============================================================================
@@ -247,6 +450,598 @@ void TestEventBus::testReceiveOwnEvents()
     QCOMPARE(received, 1);
 }
 
+void TestEventBus::testPayloadFilter()
+{
+    ExtendedSubscriptionOptions bigOrders;
+    bigOrders.filter = PayloadFilter()
+        .in("region", {"eu", "us"})
+        .range("amount", 1000, {})
+        .equals("customer.tier", "gold");
+    QList<int> received;
+    const QString id = m_bus->subscribe("orders/*", "big", [&received](const Event& e) {
+        received.append(e.data["n"].toInt());
+    }, bigOrders);
+
+    const QVariantMap gold{{"tier", "gold"}};
+    const QVariantMap silver{{"tier", "silver"}};
+    QCOMPARE(m_bus->publish("orders/created", {{"n", 1}, {"region", "eu"}, {"amount", 1500}, {"customer", gold}}, "shop"), 1);
+    QCOMPARE(m_bus->publish("orders/created", {{"n", 2}, {"region", "apac"}, {"amount", 1500}, {"customer", gold}}, "shop"), 0);
+    QCOMPARE(m_bus->publish("orders/created", {{"n", 3}, {"region", "us"}, {"amount", 999.5}, {"customer", gold}}, "shop"), 0);
+    QCOMPARE(m_bus->publish("orders/created", {{"n", 4}, {"region", "us"}, {"amount", 1000}, {"customer", silver}}, "shop"), 0);
+    QCOMPARE(m_bus->publish("orders/created", {{"n", 5}, {"region", "us"}, {"amount", 1000}}, "shop"), 0);
+    QCOMPARE(m_bus->publish("orders/updated", {{"n", 6}, {"region", "us"}, {"amount", 1e6}, {"customer", gold}}, "shop"), 1);
+
+    // Rejected events never reach the mailbox
+    QCOMPARE(m_bus->subscriptionStats(id)["queueDepth"].toInt(), 2);
+    QCoreApplication::processEvents();
+    QCOMPARE(received, QList<int>({1, 6}));
+
+    // The QML form
+    const PayloadFilter spec = PayloadFilter::fromVariantMap(
+        {{"region", QVariantList{"eu"}}, {"amount", QVariantMap{{"max", 10}}}, {"kind", "test"}});
+    QVERIFY(spec.matches({{"region", "eu"}, {"amount", 10}, {"kind", "test"}}));
+    QVERIFY(!spec.matches({{"region", "eu"}, {"amount", 11}, {"kind", "test"}}));
+    QVERIFY(!spec.matches({{"region", "eu"}, {"amount", 5}}));
+}
+
+void TestEventBus::testInternedPublish()
+{
+    const TopicId created = m_bus->registerTopic("orders/created");
+    const SenderId sender = m_bus->registerSender("plugin-a");
+    QVERIFY(created != 0);
+    QCOMPARE(m_bus->registerTopic("orders/created"), created);
+    QCOMPARE(m_bus->topicName(created), QString("orders/created"));
+
+    QStringList received;
+    SubscriptionOptions sync;
+    sync.async = false;
+    m_bus->subscribe("orders/*", "plugin-b",
+        [&received](const Event& e) { received.append(e.topic + ":" + e.senderId); }, sync);
+    m_bus->subscribe("orders/created", "plugin-a",
+        [&received](const Event&) { received.append("own"); }, sync);
+
+    // plugin-a's own event is filtered by id, plugin-b still gets it
+    QCOMPARE(m_bus->publishSync(created, {}, sender), 1);
+    QCOMPARE(m_bus->publishSync(created, {}, sender), 1);
+    QCOMPARE(received, QStringList({"orders/created:plugin-a", "orders/created:plugin-a"}));
+
+    // Stats merge string and id publishes of the same topic
+    m_bus->publishSync("orders/created", {}, "plugin-c");
+    QCOMPARE(m_bus->topicStats("orders/created").eventCount, qint64(3));
+
+    QCOMPARE(m_bus->publish(TopicId(9999), {}), 0);
+}
+
+void TestEventBus::testSharedPayload()
+{
+    const SharedPayload image = SharedPayload::fromBytes(QByteArray(1 << 20, 'x'), "image/raw");
+    const char* buffer = image.constData();
+
+    QList<const char*> seen;
+    for (int i = 0; i < 3; ++i) {
+        m_bus->subscribe("camera/frame", QString("viewer-%1").arg(i), [&seen](const Event& e) {
+            seen.append(SharedPayload::fromVariant(e.data["frame"]).constData());
+        });
+    }
+    m_bus->registerHandler("camera/last", "camera", [image](const Event&) {
+        return QVariantMap{{"frame", image.toVariant()}};
+    });
+
+    m_bus->publish("camera/frame", {{"frame", image.toVariant()}}, "camera");
+    QCoreApplication::processEvents();
+
+    // Copied once into a host buffer on the way in, which every subscriber shares
+    QCOMPARE(seen.size(), 3);
+    QVERIFY(seen[0] != buffer);
+    QCOMPARE(seen, QList<const char*>({seen[0], seen[0], seen[0]}));
+
+    // A host-owned payload is not copied again
+    const SharedPayload adopted = image.adopted();
+    QCOMPARE(adopted.adopted(), adopted);
+    seen.clear();
+    m_bus->publish("camera/frame", {{"frame", adopted.toVariant()}}, "camera");
+    QCoreApplication::processEvents();
+    QCOMPARE(seen, QList<const char*>({adopted.constData(), adopted.constData(), adopted.constData()}));
+
+    // The request/response deep copy adopts the reply's payload the same way
+    auto reply = m_bus->request("camera/last", {}, "viewer-0");
+    QVERIFY(reply.has_value());
+    const SharedPayload frame = SharedPayload::fromVariant(reply->value("frame"));
+    QVERIFY(frame.constData() != buffer);
+    QCOMPARE(frame.bytes(), image.bytes());
+    QCOMPARE(frame.mimeType(), QString("image/raw"));
+    QCOMPARE(frame.size(), qsizetype(1 << 20));
+    QCOMPARE(frame.adopted(), frame);
+
+    QVERIFY(SharedPayload::fromVariant(QVariant(42)).isNull());
+}
+
+// =============================================================================
+// Delivery targets
+// =============================================================================
+
+void TestEventBus::testCallerThreadTarget()
+{
+    int received = 0;
+    ExtendedSubscriptionOptions opts;
+    opts.target = DeliveryTarget::CallerThread;
+    m_bus->subscribe("inline", "plugin-a", [&received](const Event&) { received++; }, opts);
+
+    m_bus->publish("inline", {}, "sender");
+    QCOMPARE(received, 1);  // Already delivered, no event loop needed
+}
+
+void TestEventBus::testWorkerThreadTarget()
+{
+    QMutex mutex;
+    QList<QThread*> threads;
+    auto record = [&mutex, &threads](const Event&) {
+        QMutexLocker locker(&mutex);
+        threads.append(QThread::currentThread());
+    };
+
+    ExtendedSubscriptionOptions opts;
+    opts.target = DeliveryTarget::WorkerThread;
+    opts.workerThread = "heavy";
+    m_bus->subscribe("work", "plugin-a", record, opts);
+    m_bus->subscribe("work", "plugin-b", record, opts);
+
+    m_bus->publish("work", {}, "sender");
+
+    QTRY_COMPARE([&]() { QMutexLocker locker(&mutex); return threads.size(); }(), 2);
+    QMutexLocker locker(&mutex);
+    QVERIFY(threads[0] != QThread::currentThread());
+    QCOMPARE(threads[0], threads[1]);  // Same named worker
+    QCOMPARE(threads[0]->objectName(), QString("EventBus:heavy"));
+}
+
+void TestEventBus::testPoolTargetPreservesOrder()
+{
+    QMutex mutex;
+    QList<int> received;
+
+    ExtendedSubscriptionOptions opts;
+    opts.target = DeliveryTarget::Pool;
+    m_bus->subscribe("pool", "plugin-a", [&mutex, &received](const Event& e) {
+        QMutexLocker locker(&mutex);
+        received.append(e.data["n"].toInt());
+    }, opts);
+
+    for (int i = 0; i < 200; ++i) {
+        m_bus->publish("pool", {{"n", i}}, "sender");
+    }
+
+    QTRY_COMPARE([&]() { QMutexLocker locker(&mutex); return received.size(); }(), 200);
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < 200; ++i) {
+        QCOMPARE(received[i], i);
+    }
+}
+
+void TestEventBus::testPublishSyncKeepsTarget()
+{
+    QMutex mutex;
+    QList<int> received;
+    QList<QThread*> threads;
+    auto record = [&](const Event& e) {
+        QMutexLocker locker(&mutex);
+        received.append(e.data["n"].toInt());
+        threads.append(QThread::currentThread());
+    };
+
+    ExtendedSubscriptionOptions worker;
+    worker.target = DeliveryTarget::WorkerThread;
+    worker.workerThread = "sync";
+    m_bus->subscribe("sync/worker", "plugin-a", record, worker);
+
+    ExtendedSubscriptionOptions pool;
+    pool.target = DeliveryTarget::Pool;
+    m_bus->subscribe("sync/pool", "plugin-b", record, pool);
+
+    for (const QString topic : {QStringLiteral("sync/worker"), QStringLiteral("sync/pool")}) {
+        {
+            QMutexLocker locker(&mutex);
+            received.clear();
+            threads.clear();
+        }
+        for (int i = 0; i < 50; ++i) {
+            m_bus->publish(topic, {{"n", i}}, "sender");
+        }
+
+        // Handled on the subscription's own executor, behind what was queued
+        m_bus->publishSync(topic, {{"n", 50}}, "sender");
+
+        QMutexLocker locker(&mutex);
+        QCOMPARE(received.size(), 51);
+        for (int i = 0; i <= 50; ++i) {
+            QCOMPARE(received[i], i);
+            QVERIFY(threads[i] != QThread::currentThread());
+        }
+    }
+}
+
+void TestEventBus::testPriorityLanes()
+{
+    QStringList received;
+    ExtendedSubscriptionOptions low;
+    low.target = DeliveryTarget::OwnerThread;
+    low.priority = -1;
+    m_bus->subscribe("log/**", "logger", [&received](const Event&) { received.append("low"); }, low);
+
+    ExtendedSubscriptionOptions high = low;
+    high.priority = 10;
+    m_bus->subscribe("alarm/*", "alarms", [&received](const Event&) { received.append("high"); }, high);
+
+    // A backlog of low-priority work, then a burst of urgent events
+    for (int i = 0; i < 100; ++i) {
+        m_bus->publish("log/debug", {{"n", i}}, "app");
+    }
+    for (int i = 0; i < 50; ++i) {
+        m_bus->publish("alarm/fire", {{"n", i}}, "sensor");
+    }
+
+    QTRY_COMPARE(received.size(), 150);
+    QCOMPARE(received.first(), QString("high"));
+
+    // Overtaking is bounded: the waiting low lane gets a turn every so often
+    const qsizetype firstLow = received.indexOf("low");
+    QVERIFY(firstLow > 0);
+    QVERIFY(firstLow <= 20);
+    QVERIFY(received.lastIndexOf("high") < 100);
+}
+
+// =============================================================================
+// Mailboxes
+// =============================================================================
+
+void TestEventBus::testMailboxDropOldest()
+{
+    QList<int> received;
+    ExtendedSubscriptionOptions opts;
+    opts.queueCapacity = 3;
+    QString subId = m_bus->subscribe("burst", "plugin-a",
+        [&received](const Event& e) { received.append(e.data["n"].toInt()); }, opts);
+
+    for (int i = 1; i <= 5; ++i) {
+        m_bus->publish("burst", {{"n", i}}, "sender");
+    }
+
+    QVariantMap stats = m_bus->subscriptionStats(subId);
+    QCOMPARE(stats["queueDepth"].toInt(), 3);
+    QCOMPARE(stats["dropped"].toLongLong(), 2LL);
+
+    QCoreApplication::processEvents();
+    QCOMPARE(received, QList<int>({3, 4, 5}));
+
+    stats = m_bus->subscriptionStats(subId);
+    QCOMPARE(stats["queueDepth"].toInt(), 0);
+    QCOMPARE(stats["delivered"].toLongLong(), 3LL);
+    QCOMPARE(stats["highWater"].toInt(), 3);
+}
+
+void TestEventBus::testMailboxDropNewest()
+{
+    QList<int> received;
+    ExtendedSubscriptionOptions opts;
+    opts.queueCapacity = 3;
+    opts.overflow = OverflowPolicy::DropNewest;
+    m_bus->subscribe("burst", "plugin-a",
+        [&received](const Event& e) { received.append(e.data["n"].toInt()); }, opts);
+
+    for (int i = 1; i <= 5; ++i) {
+        m_bus->publish("burst", {{"n", i}}, "sender");
+    }
+
+    QCoreApplication::processEvents();
+    QCOMPARE(received, QList<int>({1, 2, 3}));
+
+    // Also reported per topic
+    QVariantList subs = m_bus->topicStatsAsVariant("burst")["subscriptions"].toList();
+    QCOMPARE(subs.size(), 1);
+    QCOMPARE(subs[0].toMap()["dropped"].toLongLong(), 2LL);
+}
+
+void TestEventBus::testMailboxCoalesceByKey()
+{
+    QStringList received;
+    ExtendedSubscriptionOptions opts;
+    opts.queueCapacity = 2;
+    opts.overflow = OverflowPolicy::CoalesceByKey;
+    opts.coalesceKey = "id";
+    m_bus->subscribe("prices", "plugin-a", [&received](const Event& e) {
+        received.append(e.data["id"].toString() + "=" + e.data["v"].toString());
+    }, opts);
+
+    m_bus->publish("prices", {{"id", "a"}, {"v", 1}}, "sender");
+    m_bus->publish("prices", {{"id", "b"}, {"v", 1}}, "sender");
+    m_bus->publish("prices", {{"id", "a"}, {"v", 2}}, "sender");  // Replaces a=1 in place
+
+    QCoreApplication::processEvents();
+    QCOMPARE(received, QStringList({"a=2", "b=1"}));
+}
+
+void TestEventBus::testMailboxBlock()
+{
+    QList<int> received;
+    ExtendedSubscriptionOptions opts;
+    opts.queueCapacity = 1;
+    opts.overflow = OverflowPolicy::Block;
+    QString subId = m_bus->subscribe("slow", "plugin-a",
+        [&received](const Event& e) { received.append(e.data["n"].toInt()); }, opts);
+
+    // Publisher on another thread waits for the GUI thread to make room
+    QThread* publisher = QThread::create([this]() {
+        for (int i = 1; i <= 3; ++i) {
+            m_bus->publish("slow", {{"n", i}}, "sender");
+        }
+    });
+    publisher->start();
+
+    QTRY_COMPARE(received.size(), 3);
+    QVERIFY(publisher->wait(5000));
+    delete publisher;
+    QCOMPARE(received, QList<int>({1, 2, 3}));
+    QCOMPARE(m_bus->subscriptionStats(subId)["dropped"].toLongLong(), 0LL);
+
+    // On the consuming thread itself blocking would deadlock: it drops instead
+    received.clear();
+    m_bus->publish("slow", {{"n", 4}}, "sender");
+    m_bus->publish("slow", {{"n", 5}}, "sender");
+    QCoreApplication::processEvents();
+    QCOMPARE(received, QList<int>({4}));
+    QCOMPARE(m_bus->subscriptionStats(subId)["dropped"].toLongLong(), 1LL);
+}
+
+void TestEventBus::testSubscriptionConflation()
+{
+    QStringList received;
+    ExtendedSubscriptionOptions opts;
+    opts.conflate = true;
+    opts.conflationKey = "sensor";
+    QString subId = m_bus->subscribe("telemetry/temp", "ui", [&received](const Event& e) {
+        received.append(e.data["sensor"].toString() + "=" + e.data["v"].toString());
+    }, opts);
+
+    for (int i = 0; i < 100; ++i) {
+        m_bus->publish("telemetry/temp", {{"sensor", i % 2 ? "b" : "a"}, {"v", i}}, "device");
+    }
+    QCOMPARE(m_bus->subscriptionStats(subId)["queueDepth"].toInt(), 2);
+
+    QCoreApplication::processEvents();
+    QCOMPARE(received, QStringList({"a=98", "b=99"}));
+    QCOMPARE(m_bus->subscriptionStats(subId)["conflated"].toLongLong(), 98LL);
+    QCOMPARE(m_bus->subscriptionStats(subId)["dropped"].toLongLong(), 0LL);
+}
+
+void TestEventBus::testTopicConflation()
+{
+    m_bus->setTopicConflation("progress/*");
+
+    QList<int> a;
+    QList<int> b;
+    m_bus->subscribe("progress/*", "a", [&a](const Event& e) { a.append(e.data["p"].toInt()); });
+    m_bus->subscribe("progress/import", "b", [&b](const Event& e) { b.append(e.data["p"].toInt()); });
+    m_bus->subscribe("other", "b", [&b](const Event& e) { b.append(e.data["p"].toInt()); });
+
+    for (int p = 0; p <= 100; ++p) {
+        m_bus->publish("progress/import", {{"p", p}}, "importer");
+    }
+    m_bus->publish("other", {{"p", 1}}, "x");
+    m_bus->publish("other", {{"p", 2}}, "x");
+
+    QCoreApplication::processEvents();
+    QCOMPARE(a, QList<int>({100}));
+    QCOMPARE(b, QList<int>({100, 1, 2}));  // "other" is not conflated
+
+    QVERIFY(m_bus->clearTopicConflation("progress/*"));
+    QVERIFY(!m_bus->clearTopicConflation("progress/*"));
+}
+
+void TestEventBus::testThrottleDebounce()
+{
+    ExtendedSubscriptionOptions throttled;
+    throttled.throttleMs = 200;
+    QList<int> edges;
+    const QString throttleId = m_bus->subscribe("sensor/*", "throttle", [&edges](const Event& e) {
+        edges.append(e.data["v"].toInt());
+    }, throttled);
+
+    ExtendedSubscriptionOptions debounced;
+    debounced.debounceMs = 50;
+    QList<int> settled;
+    const QString debounceId = m_bus->subscribe("sensor/*", "debounce", [&settled](const Event& e) {
+        settled.append(e.data["v"].toInt());
+    }, debounced);
+
+    // Leading edge at once, the rest of the burst collapses into the trailing edge
+    for (int v = 1; v <= 10; ++v) {
+        m_bus->publish("sensor/level", {{"v", v}}, "device");
+    }
+    QCoreApplication::processEvents();
+    QCOMPARE(edges, QList<int>({1}));
+    QVERIFY(settled.isEmpty());
+
+    QTRY_COMPARE(settled, QList<int>({10}));
+    QTRY_COMPARE(edges, QList<int>({1, 10}));
+    QCOMPARE(m_bus->subscriptionStats(throttleId)["suppressed"].toLongLong(), 8LL);
+    QCOMPARE(m_bus->subscriptionStats(debounceId)["suppressed"].toLongLong(), 9LL);
+
+    m_bus->unsubscribe(throttleId);
+    m_bus->unsubscribe(debounceId);
+}
+
+void TestEventBus::testPublishSyncThrottled()
+{
+    ExtendedSubscriptionOptions throttled;
+    throttled.throttleMs = 200;
+    QList<int> edges;
+    const QString throttleId = m_bus->subscribe("sensor/*", "throttle", [&edges](const Event& e) {
+        edges.append(e.data["v"].toInt());
+    }, throttled);
+
+    ExtendedSubscriptionOptions conflated;
+    conflated.conflate = true;
+    QList<int> latest;
+    const QString conflateId = m_bus->subscribe("sensor/*", "conflate", [&latest](const Event& e) {
+        latest.append(e.data["v"].toInt());
+    }, conflated);
+
+    // publishSync goes through the gate and the slot instead of around them
+    for (int v = 1; v <= 10; ++v) {
+        m_bus->publishSync("sensor/level", {{"v", v}}, "device");
+    }
+    QCoreApplication::processEvents();
+    QCOMPARE(edges, QList<int>({1}));
+    QCOMPARE(latest, QList<int>({10}));
+
+    QTRY_COMPARE(edges, QList<int>({1, 10}));
+    QCOMPARE(m_bus->subscriptionStats(throttleId)["suppressed"].toLongLong(), 8LL);
+
+    m_bus->unsubscribe(throttleId);
+    m_bus->unsubscribe(conflateId);
+}
+
+void TestEventBus::testTopicSequencing()
+{
+    m_bus->setTopicSequencing("prices/*");
+
+    QList<EventSequence> seen;
+    ExtendedSubscriptionOptions opts;
+    opts.queueCapacity = 2;
+    const QString id = m_bus->subscribe("prices/*", "ticker", [&seen](const Event&) {
+        seen.append(EventBusService::currentSequence());
+    }, opts);
+
+    m_bus->publish("prices/eur", {{"v", 1}}, "feed");
+    QCoreApplication::processEvents();
+
+    // 2..4 fall out of the full mailbox
+    for (int v = 2; v <= 6; ++v) {
+        m_bus->publish("prices/eur", {{"v", v}}, "feed");
+    }
+    QCoreApplication::processEvents();
+    QCOMPARE(seen.size(), 3);
+    QCOMPARE(seen[0].sequence, quint64(1));
+    QCOMPARE(seen[0].missed, quint64(0));
+    QCOMPARE(seen[1].sequence, quint64(5));
+    QCOMPARE(seen[1].missed, quint64(3));
+    QCOMPARE(seen[2].sequence, quint64(6));
+    QCOMPARE(seen[2].missed, quint64(0));
+    QCOMPARE(m_bus->subscriptionStats(id)["missed"].toLongLong(), 3LL);
+
+    // Numbered per topic, inline deliveries included
+    EventSequence handled;
+    ExtendedSubscriptionOptions caller;
+    caller.target = DeliveryTarget::CallerThread;
+    m_bus->subscribe("prices/usd", "inline", [&handled](const Event&) {
+        handled = EventBusService::currentSequence();
+    }, caller);
+    m_bus->publishSync("prices/usd", {{"v", 1}}, "feed");
+    QCOMPARE(handled.sequence, quint64(1));
+
+    // Not sequenced, and outside of any handler
+    m_bus->subscribe("quotes/usd", "inline", [&handled](const Event&) {
+        handled = EventBusService::currentSequence();
+    }, caller);
+    m_bus->publish("quotes/usd", {}, "feed");
+    QCOMPARE(handled.sequence, quint64(0));
+    QCOMPARE(EventBusService::currentSequence().sequence, quint64(0));
+}
+
+void TestEventBus::testSequencingIgnoresRejected()
+{
+    m_bus->setTopicSequencing("orders/*");
+
+    QList<EventSequence> seen;
+    ExtendedSubscriptionOptions opts;
+    opts.filter = PayloadFilter().equals("region", "eu");
+    const QString id = m_bus->subscribe("orders/*", "shop", [&seen](const Event&) {
+        seen.append(EventBusService::currentSequence());
+    }, opts);
+
+    // Other regions and the subscriber's own events are not wanted, so not missed
+    for (int n = 0; n < 20; ++n) {
+        const QString region = n % 3 == 0 ? "eu" : "us";
+        m_bus->publish("orders/created", {{"n", n}, {"region", region}}, n % 5 == 0 ? "shop" : "feed");
+        if (n % 7 == 0) {
+            QCoreApplication::processEvents();
+        }
+    }
+    QCoreApplication::processEvents();
+
+    QVERIFY(seen.size() > 1);
+    for (const EventSequence& sequence : std::as_const(seen)) {
+        QCOMPARE(sequence.missed, quint64(0));
+    }
+    QCOMPARE(m_bus->subscriptionStats(id)["missed"].toLongLong(), 0LL);
+
+    // A real loss is still reported
+    ExtendedSubscriptionOptions lossy = opts;
+    lossy.queueCapacity = 1;
+    QList<EventSequence> lossySeen;
+    m_bus->subscribe("orders/*", "audit", [&lossySeen](const Event&) {
+        lossySeen.append(EventBusService::currentSequence());
+    }, lossy);
+    m_bus->publish("orders/created", {{"region", "eu"}}, "feed");
+    QCoreApplication::processEvents();
+    m_bus->publish("orders/created", {{"region", "us"}}, "feed");
+    m_bus->publish("orders/created", {{"region", "eu"}}, "feed");   // Dropped by the next one
+    m_bus->publish("orders/created", {{"region", "us"}}, "feed");
+    m_bus->publish("orders/created", {{"region", "eu"}}, "feed");
+    QCoreApplication::processEvents();
+    QCOMPARE(lossySeen.size(), 2);
+    QCOMPARE(lossySeen[1].missed, quint64(1));
+
+    // Clearing releases the counters; numbering starts over
+    QVERIFY(m_bus->clearTopicSequencing("orders/*"));
+    m_bus->setTopicSequencing("orders/*");
+    m_bus->publish("orders/created", {{"region", "eu"}}, "feed");
+    QCoreApplication::processEvents();
+    QCOMPARE(lossySeen.last().sequence, quint64(1));
+    QCOMPARE(lossySeen.last().missed, quint64(0));
+}
+
+void TestEventBus::testRetainedReplay()
+{
+    m_bus->setTopicRetention("config/*");
+    m_bus->setTopicRetention("log", 3);
+
+    m_bus->publish("config/theme", {{"v", 1}}, "settings");
+    m_bus->publish("config/theme", {{"v", 2}}, "settings");
+    m_bus->publish("config/lang", {{"v", 1}}, "settings");
+    for (int i = 0; i < 5; ++i) {
+        m_bus->publish("log", {{"v", i}}, "logger");
+    }
+    m_bus->publish("untracked", {{"v", 1}}, "x");
+    QCoreApplication::processEvents();
+
+    QCOMPARE(m_bus->retainedValue("config/theme")["v"].toInt(), 2);
+    QVERIFY(m_bus->retainedValue("untracked").isEmpty());
+
+    // Late subscriber: current state first, then live events
+    QStringList config;
+    ExtendedSubscriptionOptions replayLatest;
+    replayLatest.replay = 1;
+    m_bus->subscribe("config/*", "late", [&config](const Event& e) {
+        config.append(e.topic + "=" + e.data["v"].toString());
+    }, replayLatest);
+    m_bus->publish("config/theme", {{"v", 3}}, "settings");
+    QCoreApplication::processEvents();
+    QCOMPARE(config, QStringList({"config/theme=2", "config/lang=1", "config/theme=3"}));
+
+    // The ring keeps the last 3; CallerThread subscribers replay inline
+    QList<int> log;
+    ExtendedSubscriptionOptions replayAll;
+    replayAll.replay = -1;
+    replayAll.target = DeliveryTarget::CallerThread;
+    m_bus->subscribe("log", "late", [&log](const Event& e) { log.append(e.data["v"].toInt()); }, replayAll);
+    QCOMPARE(log, QList<int>({2, 3, 4}));
+
+    QVERIFY(m_bus->clearTopicRetention("log"));
+    QVERIFY(m_bus->retainedValue("log").isEmpty());
+    QVERIFY(!m_bus->clearTopicRetention("log"));
+}
+
 // =============================================================================
 // Query
 // =============================================================================
@@ -305,6 +1100,236 @@ void TestEventBus::testSubscriptionsFor()
     QVERIFY(subs.contains(s2));
 }
 
+void TestEventBus::testDeliveryCache()
+{
+    QStringList order;
+    SubscriptionOptions low;
+    low.priority = 1;
+    low.async = false;
+    m_bus->subscribe("cache/topic", "low", [&order](const Event&) { order.append("low"); }, low);
+
+    m_bus->publishSync("cache/topic", {}, "sender");
+    m_bus->publishSync("cache/topic", {}, "sender");
+
+    QVariantMap stats = m_bus->deliveryCacheStats();
+    QCOMPARE(stats["misses"].toLongLong(), 1LL);
+    QCOMPARE(stats["hits"].toLongLong(), 1LL);
+
+    // A new subscription invalidates the memoized list and is sorted in
+    SubscriptionOptions high;
+    high.priority = 10;
+    high.async = false;
+    m_bus->subscribe("cache/*", "high", [&order](const Event&) { order.append("high"); }, high);
+
+    order.clear();
+    m_bus->publishSync("cache/topic", {}, "sender");
+    QCOMPARE(order, QStringList({"high", "low"}));
+
+    stats = m_bus->deliveryCacheStats();
+    QCOMPARE(stats["misses"].toLongLong(), 2LL);
+
+    // Past the cap (4096 topics) one entry goes per miss; a hot topic stays
+    for (int i = 0; i < 5000; ++i) {
+        m_bus->publishSync(QString("cache/id-%1").arg(i), {}, "sender");
+        m_bus->publishSync("cache/topic", {}, "sender");
+    }
+    stats = m_bus->deliveryCacheStats();
+    QCOMPARE(stats["entries"].toInt(), 4096);
+    QCOMPARE(stats["misses"].toLongLong(), 2LL + 5000);
+}
+
+void TestEventBus::testLatencyHistogram()
+{
+    LatencyHistogram histogram;
+    for (int us = 1; us <= 1000; ++us) {
+        histogram.record(us);
+    }
+
+    QCOMPARE(histogram.count(), qint64(1000));
+    QCOMPARE(histogram.max(), qint64(1000));
+    // Within the 12.5% bucket precision
+    QVERIFY(qAbs(histogram.percentile(50) - 500) <= 500 / 8);
+    QVERIFY(qAbs(histogram.percentile(99) - 990) <= 990 / 8);
+    QCOMPARE(histogram.percentile(100), qint64(1000));
+}
+
+void TestEventBus::testTopicMetrics()
+{
+    SubscriptionOptions sync;
+    sync.async = false;
+    const QString subId = m_bus->subscribe("metrics/*", "slow",
+        [](const Event&) { QThread::msleep(2); }, sync);
+
+    for (int i = 0; i < 10; ++i) {
+        m_bus->publishSync("metrics/a", {{"i", i}}, "test");
+    }
+
+    const QVariantMap stats = m_bus->topicStatsAsVariant("metrics/a");
+    QCOMPARE(stats["eventCount"].toLongLong(), 10LL);
+    QVERIFY(stats["rates"].toMap()["10s"].toDouble() >= 1.0);
+
+    const QVariantMap handlerTime = stats["handlerTimeUs"].toMap();
+    QCOMPARE(handlerTime["count"].toLongLong(), 10LL);
+    QVERIFY(handlerTime["p50"].toLongLong() >= 1500);
+    QCOMPARE(stats["deliveryLatencyUs"].toMap()["count"].toLongLong(), 10LL);
+
+    QCOMPARE(m_bus->subscriptionStats(subId)["handlerTimeUs"].toMap()["count"].toLongLong(), 10LL);
+
+    const QVariantMap snapshot = m_bus->metricsSnapshot();
+    const QVariantList topics = snapshot["topics"].toList();
+    QCOMPARE(topics.size(), 1);
+    QCOMPARE(topics.first().toMap()["topic"].toString(), QString("metrics/a"));
+    QCOMPARE(snapshot["subscriptions"].toList().size(), 1);
+}
+
+void TestEventBus::testBoundedTopicStats()
+{
+    // A few hot topics among a long tail of one-off topics
+    for (int i = 0; i < 20000; ++i) {
+        m_bus->publishSync(QString("orders/%1/updated").arg(i), {}, "orders");
+        if (i % 10 == 0) {
+            m_bus->publishSync(QString("hot/%1").arg(i % 30), {}, "hot");
+        }
+    }
+
+    const QVariantList topics = m_bus->metricsSnapshot()["topics"].toList();
+    QVERIFY(topics.size() <= 512);
+
+    // Hot topics have exact stats, the tail is estimated
+    const QVariantMap hot = m_bus->topicStatsAsVariant("hot/0");
+    QVERIFY(hot["exact"].toBool());
+    QVERIFY(hot["eventCount"].toLongLong() >= 667);
+
+    TopicStats tail = m_bus->topicStats("orders/19998/updated");
+    QVERIFY(tail.eventCount >= 1);
+    QVERIFY(tail.eventCount < 100);
+}
+
+void TestEventBus::testTopicAdmissionEvictsLightest()
+{
+    // Fill every tracked slot; t/0 is heavier than the rest
+    for (int i = 0; i < 512; ++i) {
+        for (int n = 0; n < (i == 0 ? 10 : 2); ++n) {
+            m_bus->publishSync(QString("t/%1").arg(i), {}, "sender");
+        }
+    }
+    QCOMPARE(m_bus->metricsSnapshot()["topics"].toList().size(), 512);
+
+    // Overtakes the lightest ones and displaces them, the heavy one stays
+    for (int round = 0; round < 3; ++round) {
+        for (int n = 0; n < 4; ++n) {
+            m_bus->publishSync(QString("late/%1").arg(round), {}, "sender");
+        }
+        QVERIFY(m_bus->topicStatsAsVariant(QString("late/%1").arg(round))["exact"].toBool());
+    }
+    QCOMPARE(m_bus->metricsSnapshot()["topics"].toList().size(), 512);
+    QVERIFY(m_bus->topicStatsAsVariant("t/0")["exact"].toBool());
+    QCOMPARE(m_bus->topicStatsAsVariant("t/0")["eventCount"].toLongLong(), 10LL);
+}
+
+void TestEventBus::testSlowHandlerWatchdog()
+{
+    SlowHandlerPolicy policy;
+    policy.budgetMs = 5;
+    policy.demoteAfter = 2;
+    m_bus->setSlowHandlerPolicy(policy);
+
+    QAtomicInt slowCalls;
+    QAtomicPointer<QThread> slowThread;
+    const QString slowId = m_bus->subscribe("ui/refresh", "slow-plugin",
+        [&slowCalls, &slowThread](const Event&) {
+            QThread::msleep(20);
+            slowThread.storeRelease(QThread::currentThread());
+            slowCalls.fetchAndAddOrdered(1);
+        }, ExtendedSubscriptionOptions());
+    int fastCalls = 0;
+    m_bus->subscribe("ui/refresh", "fast-plugin", [&fastCalls](const Event&) { ++fastCalls; },
+                     ExtendedSubscriptionOptions());
+    QSignalSpy demoted(m_bus, &EventBusService::handlerDemoted);
+
+    // Reported from the first violation, demoted on the second
+    m_bus->publishSync("ui/refresh", {}, "app");
+    QCOMPARE(m_bus->slowHandlers().size(), 1);
+    QCOMPARE(demoted.count(), 0);
+    m_bus->publishSync("ui/refresh", {}, "app");
+    QCOMPARE(demoted.count(), 1);
+    QCOMPARE(demoted.first().at(0).toString(), slowId);
+    QCOMPARE(slowThread.loadAcquire(), QThread::currentThread());
+
+    // publishSync no longer runs it inline
+    QCOMPARE(m_bus->publishSync("ui/refresh", {}, "app"), 2);
+    QCOMPARE(fastCalls, 3);
+    QTRY_COMPARE(slowCalls.loadAcquire(), 3);
+    QVERIFY(slowThread.loadAcquire() != QThread::currentThread());
+
+    const QVariantMap offender = m_bus->slowHandlers().first().toMap();
+    QCOMPARE(offender["id"].toString(), slowId);
+    QCOMPARE(offender["subscriberId"].toString(), QString("slow-plugin"));
+    QCOMPARE(offender["lastTopic"].toString(), QString("ui/refresh"));
+    QVERIFY(offender["demoted"].toBool());
+    QVERIFY(offender["violations"].toLongLong() >= 3);
+    QVERIFY(offender["worstUs"].toLongLong() >= 5000);
+}
+
+void TestEventBus::testDemotionKeepsOrder()
+{
+    SlowHandlerPolicy policy;
+    policy.budgetMs = 5;
+    policy.demoteAfter = 1;
+    m_bus->setSlowHandlerPolicy(policy);
+
+    constexpr int kPublishers = 4;
+    constexpr int kEvents = 200;
+
+    // lastSeen and ordered are only used by the handler, which must never run on two threads at once
+    QAtomicInt running;
+    QAtomicInt overlaps;
+    QAtomicInt delivered;
+    QAtomicInt first(1);
+    QList<int> lastSeen(kPublishers, -1);
+    bool ordered = true;
+
+    ExtendedSubscriptionOptions opts;
+    opts.queueCapacity = 0;
+    m_bus->subscribe("load/*", "slow-plugin", [&](const Event& e) {
+        if (running.fetchAndAddOrdered(1) != 0) {
+            overlaps.fetchAndAddOrdered(1);
+        }
+        if (first.testAndSetOrdered(1, 0)) {
+            QThread::msleep(20);  // Demoted right after this call, mid-flood
+        }
+        const int publisher = e.data["p"].toInt();
+        const int n = e.data["n"].toInt();
+        ordered = ordered && n == lastSeen[publisher] + 1;
+        lastSeen[publisher] = n;
+        running.fetchAndAddOrdered(-1);
+        delivered.fetchAndAddOrdered(1);
+    }, opts);
+    QSignalSpy demoted(m_bus, &EventBusService::handlerDemoted);
+
+    QList<QThread*> publishers;
+    for (int p = 0; p < kPublishers; ++p) {
+        publishers.append(QThread::create([this, p]() {
+            for (int n = 0; n < kEvents; ++n) {
+                m_bus->publish("load/" + QString::number(p), {{"p", p}, {"n", n}}, "publisher");
+                QThread::usleep(200);  // Still publishing while the demotion happens
+            }
+        }));
+        publishers.last()->start();
+    }
+
+    // The owner thread drains while the publishers run
+    QTRY_COMPARE(delivered.loadAcquire(), kPublishers * kEvents);
+    for (QThread* thread : std::as_const(publishers)) {
+        thread->wait();
+        delete thread;
+    }
+
+    QCOMPARE(demoted.count(), 1);
+    QCOMPARE(overlaps.loadAcquire(), 0);
+    QVERIFY(ordered);
+}
+
 // =============================================================================
 // Request/Response
 // =============================================================================
@@ -403,6 +1428,418 @@ void TestEventBus::testRequestFromQml()
     QCOMPARE(fail["__success"].toBool(), false);
 }
 
+void TestEventBus::testRequestAsync()
+{
+    RequestHandlerOptions pool;
+    pool.target = DeliveryTarget::Pool;
+    m_bus->registerHandler("math/square", "math", [](const Event& e) -> QVariantMap {
+        const int n = e.data["n"].toInt();
+        return {{"result", n * n}, {"onMainThread", QThread::currentThread() == qApp->thread()}};
+    }, pool);
+
+    // Many requests in flight at once
+    QList<QFuture<QVariantMap>> futures;
+    for (int n = 0; n < 20; ++n) {
+        futures.append(m_bus->requestAsync("math/square", {{"n", n}}, "client", 5000));
+    }
+    for (int n = 0; n < 20; ++n) {
+        futures[n].waitForFinished();
+        QVERIFY(!futures[n].isCanceled());
+        QCOMPARE(futures[n].result()["result"].toInt(), n * n);
+        QCOMPARE(futures[n].result()["onMainThread"].toBool(), false);
+    }
+
+    // No handler: finished and canceled right away
+    QFuture<QVariantMap> missing = m_bus->requestAsync("math/unknown");
+    QVERIFY(missing.isFinished());
+    QVERIFY(missing.isCanceled());
+}
+
+void TestEventBus::testRequestTimeout()
+{
+    RequestHandlerOptions worker;
+    worker.target = DeliveryTarget::WorkerThread;
+    worker.workerThread = "slow";
+    m_bus->registerHandler("slow/op", "slow", [](const Event&) -> QVariantMap {
+        QThread::msleep(200);
+        return {{"done", true}};
+    }, worker);
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(!m_bus->request("slow/op", {}, "client", 20).has_value());
+    QVERIFY(timer.elapsed() < 200);
+
+    QFuture<QVariantMap> future = m_bus->requestAsync("slow/op", {}, "client", 20);
+    QTRY_VERIFY(future.isFinished());
+    QVERIFY(future.isCanceled());
+
+    // Without a deadline the reply arrives
+    auto reply = m_bus->request("slow/op", {}, "client");
+    QVERIFY(reply.has_value());
+    QCOMPARE(reply->value("done").toBool(), true);
+
+    // A pool handler requesting from another pool handler runs it inline,
+    // so a pool full of waiting requesters cannot wait for itself
+    RequestHandlerOptions pool;
+    pool.target = DeliveryTarget::Pool;
+    m_bus->registerHandler("pool/inner", "inner", [](const Event&) -> QVariantMap {
+        return {{"thread", QVariant::fromValue(static_cast<void*>(QThread::currentThread()))}};
+    }, pool);
+    m_bus->registerHandler("pool/outer", "outer", [this](const Event&) -> QVariantMap {
+        const auto inner = m_bus->request("pool/inner", {}, "outer");
+        return {{"inline", inner && inner->value("thread").value<void*>() == QThread::currentThread()}};
+    }, pool);
+
+    QList<QFuture<QVariantMap>> outer;
+    for (int i = 0; i < m_bus->deliveryPool()->maxThreadCount() * 2; ++i) {
+        outer.append(m_bus->requestAsync("pool/outer", {}, "client"));
+    }
+    for (const QFuture<QVariantMap>& future : std::as_const(outer)) {
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 5000);
+        QVERIFY(future.result().value("inline").toBool());
+    }
+}
+
+void TestEventBus::testGather()
+{
+    RequestHandlerOptions pool;
+    pool.target = DeliveryTarget::Pool;
+    for (int i = 0; i < 3; ++i) {
+        m_bus->registerGatherHandler("search/query", QString("provider-%1").arg(i),
+            [i](const Event& e) -> QVariantMap {
+                return {{"hits", QStringList{e.data["q"].toString() + QString::number(i)}}};
+            }, pool);
+    }
+    RequestHandlerOptions slowWorker;
+    slowWorker.target = DeliveryTarget::WorkerThread;
+    slowWorker.workerThread = "slow-search";
+    m_bus->registerGatherHandler("search/query", "slow", [](const Event&) -> QVariantMap {
+        QThread::msleep(300);
+        return {{"hits", QStringList{"late"}}};
+    }, slowWorker);
+    QVERIFY(!m_bus->registerGatherHandler("search/query", "slow", [](const Event&) { return QVariantMap(); }));
+
+    // Deadline: the slow provider is left out
+    GatherOptions deadline;
+    deadline.timeoutMs = 50;
+    QFuture<QVariantMap> future = m_bus->gather("search/query", {{"q", "a"}}, "ui", deadline);
+    QTRY_VERIFY(future.isFinished());
+    QVariantMap replies = future.result();
+    QCOMPARE(replies.size(), 3);
+    QCOMPARE(replies["provider-1"].toMap()["hits"].toStringList(), QStringList{"a1"});
+
+    // Quorum: done after the first two replies
+    GatherOptions quorum;
+    quorum.quorum = 2;
+    future = m_bus->gather("search/query", {{"q", "b"}}, "ui", quorum);
+    QTRY_VERIFY(future.isFinished());
+    QCOMPARE(future.result().size(), 2);
+
+    // All replies
+    m_bus->unregisterAllHandlers("provider-0");
+    future = m_bus->gather("search/query", {{"q", "c"}}, "ui");
+    QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 5000);
+    QCOMPARE(future.result().keys(), QStringList({"provider-1", "provider-2", "slow"}));
+
+    // No handlers: an empty result right away
+    future = m_bus->gather("search/none");
+    QVERIFY(future.isFinished());
+    QVERIFY(future.result().isEmpty());
+}
+
+void TestEventBus::testNextEvent()
+{
+    QFuture<Event> next = m_bus->nextEvent("jobs/*/done", 0, "waiter");
+    QCOMPARE(m_bus->subscriberCount("jobs/1/done"), 1);
+    m_bus->publish("jobs/1/started", {}, "runner");
+    QVERIFY(!next.isFinished());
+
+    // Settles inline with the first match and drops its subscription
+    m_bus->publish("jobs/1/done", {{"ok", true}}, "runner");
+    QVERIFY(next.isFinished());
+    QCOMPARE(next.result().topic, QString("jobs/1/done"));
+    QVERIFY(next.result().data["ok"].toBool());
+    QCOMPARE(m_bus->subscriberCount("jobs/1/done"), 0);
+
+    // Deadline
+    next = m_bus->nextEvent("jobs/*/done", 20);
+    QTRY_VERIFY(next.isFinished());
+    QVERIFY(next.isCanceled());
+    QCOMPARE(m_bus->subscriberCount("jobs/2/done"), 0);
+
+    // Canceled by the caller: unsubscribes without waiting for a match, and
+    // the internal subscription never shows up in the change signals
+    QSignalSpy subscribersChanged(m_bus, &EventBusService::subscribersChanged);
+    QSignalSpy topicsChanged(m_bus, &EventBusService::topicsChanged);
+    next = m_bus->nextEvent("jobs/*/done");
+    QCOMPARE(m_bus->subscriberCount("jobs/3/done"), 1);
+    next.cancel();
+    QTRY_COMPARE(m_bus->subscriberCount("jobs/3/done"), 0);
+    QVERIFY(next.isFinished());
+    QVERIFY(next.isCanceled());
+    m_bus->publish("jobs/3/done", {}, "runner");
+    QCOMPARE(next.resultCount(), 0);
+    QCOMPARE(subscribersChanged.count(), 0);
+    QCOMPARE(topicsChanged.count(), 0);
+
+#ifdef MPF_HAS_COROUTINES
+    // Holds the handler until the flow is known to be suspended on its reply
+    QSemaphore gate;
+    m_bus->registerHandler("jobs/start", "runner", [this, &gate](const Event& e) -> QVariantMap {
+        gate.acquire();
+        const QString id = e.data["id"].toString();
+        QTimer::singleShot(10, m_bus, [this, id]() { m_bus->publish("jobs/" + id + "/done", {}, "runner"); });
+        return {{"id", id}};
+    });
+
+    QStringList steps;
+    auto flow = [](EventBusService* bus, QStringList* steps) -> EventTask {
+        const auto started = co_await bus->requestAsync("jobs/start", {{"id", "7"}}, "flow", 1000);
+        steps->append(started ? "started:" + started->value("id").toString() : "no reply");
+        const auto done = co_await bus->nextEvent("jobs/7/done", 1000);
+        steps->append(done ? done->topic : "timeout");
+        const auto never = co_await bus->nextEvent("jobs/8/done", 10);
+        steps->append(never ? never->topic : "timeout");
+    };
+    {
+        const QSemaphoreReleaser releaser(gate);
+        flow(m_bus, &steps);
+        QVERIFY(steps.isEmpty());           // Suspended, nothing blocked
+    }
+    QTRY_COMPARE(steps, QStringList({"started:7", "jobs/7/done", "timeout"}));
+#endif
+}
+
+// =============================================================================
+// Journal
+// =============================================================================
+
+void TestEventBus::testJournalRoundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    JournalOptions options;
+    options.segmentBytes = 4096;            // Force rotation
+    auto journal = std::make_shared<EventJournal>(dir.path(), options);
+    QVERIFY(journal->isOpen());
+    m_bus->setJournal(journal);
+
+    for (int i = 0; i < 200; ++i) {
+        if (i % 2) {
+            m_bus->publishSync("journal/sync", {{"i", i}}, "writer");
+        } else {
+            m_bus->publish("journal/async", {{"i", i}, {"name", "event"}}, "writer");
+        }
+    }
+    journal->flush();
+    QCOMPARE(journal->stats()["recorded"].toLongLong(), 200);
+    QCOMPARE(journal->stats()["dropped"].toLongLong(), 0);
+
+    EventJournalReader reader(dir.path());
+    QVERIFY(reader.segmentCount() > 1);
+
+    qint64 lastMicros = 0;
+    for (int i = 0; i < 200; ++i) {
+        const auto record = reader.next();
+        QVERIFY(record);
+        QCOMPARE(record->event.topic, QString(i % 2 ? "journal/sync" : "journal/async"));
+        QCOMPARE(record->event.senderId, QString("writer"));
+        QCOMPARE(record->event.data["i"].toInt(), i);
+        QCOMPARE(record->synchronous, bool(i % 2));
+        QVERIFY(record->monotonicMicros >= lastMicros);
+        lastMicros = record->monotonicMicros;
+    }
+    QVERIFY(!reader.next());
+
+    // Detached journals record nothing more
+    m_bus->setJournal(nullptr);
+    m_bus->publish("journal/async", {}, "writer");
+    journal->flush();
+    QCOMPARE(journal->stats()["recorded"].toLongLong(), 200);
+}
+
+void TestEventBus::testJournalReplay()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        auto journal = std::make_shared<EventJournal>(dir.path());
+        m_bus->setJournal(journal);
+        QList<Event> batch;
+        for (int i = 0; i < 200; ++i) {
+            Event event;
+            event.topic = QString("replay/%1").arg(i % 4);
+            event.senderId = "recorder";
+            event.data = {{"i", i}};
+            batch.append(event);
+        }
+        m_bus->publishBatch(batch);
+        m_bus->setJournal(nullptr);
+    }   // Destroying the journal writes out everything queued
+
+    EventBusService target;
+    QList<int> received;
+    target.subscribe("replay/**", "observer", [&received](const Event& e) {
+        received.append(e.data["i"].toInt());
+    });
+
+    JournalReplayer replayer(&target, dir.path());
+    replayer.setSpeed(0);
+    QSignalSpy finished(&replayer, &JournalReplayer::finished);
+    replayer.start();
+
+    QTRY_COMPARE(finished.count(), 1);
+    QCOMPARE(replayer.replayed(), 200);
+    QTRY_COMPARE(received.size(), 200);
+    for (int i = 0; i < 200; ++i) {
+        QCOMPARE(received[i], i);
+    }
+}
+
+void TestEventBus::testJournalReplaySkipsGapBetweenRuns()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    for (int run = 0; run < 2; ++run) {
+        if (run > 0) {
+            QThread::msleep(600);
+        }
+        auto journal = std::make_shared<EventJournal>(dir.path());
+        m_bus->setJournal(journal);
+        m_bus->publish("runs/event", {{"run", run}}, "recorder");
+        m_bus->publish("runs/event", {{"run", run}}, "recorder");
+        m_bus->setJournal(nullptr);
+    }
+
+    EventJournalReader reader(dir.path());
+    QCOMPARE(reader.segmentCount(), 2);
+    QList<bool> starts;
+    while (const auto record = reader.next()) {
+        starts.append(record->runStart);
+    }
+    QCOMPARE(starts, QList<bool>({true, false, true, false}));
+
+    EventBusService target;
+    JournalReplayer replayer(&target, dir.path());
+    QSignalSpy finished(&replayer, &JournalReplayer::finished);
+    QElapsedTimer clock;
+    clock.start();
+    replayer.start();
+
+    // Paced in real time, but without waiting out the pause between the runs
+    QTRY_COMPARE(finished.count(), 1);
+    QCOMPARE(replayer.replayed(), 4);
+    QVERIFY(clock.elapsed() < 400);
+}
+
+void TestEventBus::testJournalSegmentFailure()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    JournalOptions options;
+    options.segmentBytes = 4096;            // Rotates every few records
+    auto journal = std::make_shared<EventJournal>(dir.path(), options);
+    QVERIFY(journal->isOpen());
+    m_bus->setJournal(journal);
+
+    // Rotation can't create the next segment: records are dropped, flush still returns
+    QVERIFY(QDir(dir.path()).removeRecursively());
+    for (int i = 0; i < 200; ++i) {
+        m_bus->publish("journal/lost", {{"i", i}, {"name", "event"}}, "writer");
+    }
+    journal->flush();
+    const qint64 recorded = journal->stats()["recorded"].toLongLong();
+    QVERIFY(journal->stats()["dropped"].toLongLong() > 0);
+    QCOMPARE(recorded + journal->stats()["dropped"].toLongLong(), 200);
+
+    // Retried after the backoff once the directory is back
+    QVERIFY(QDir().mkpath(dir.path()));
+    QElapsedTimer clock;
+    clock.start();
+    while (journal->stats()["recorded"].toLongLong() == recorded && clock.elapsed() < 5000) {
+        m_bus->publish("journal/again", {}, "writer");
+        journal->flush();
+        QTest::qWait(50);
+    }
+    QVERIFY(journal->stats()["recorded"].toLongLong() > recorded);
+    m_bus->setJournal(nullptr);
+}
+
+// =============================================================================
+// Bridge
+// =============================================================================
+
+void TestEventBus::testBridge()
+{
+    const QString name = QString("mpf-test-bridge-%1").arg(QCoreApplication::applicationPid());
+    EventBusBridge local(m_bus, name);
+    local.setRingCapacity(64 * 1024);       // Small enough to exercise backpressure
+    QVERIFY(local.listen());
+    local.forward("sensor/**");
+
+    EventBusService remoteBus;
+    EventBusBridge remote(&remoteBus, name + "-peer");
+    remote.setRingCapacity(64 * 1024);
+    remote.forward("sensor/**");            // Must not send the events back
+    QSignalSpy connected(&remote, &EventBusBridge::peerConnected);
+    remote.connectToPeer(name);
+    QTRY_COMPARE(connected.count(), 1);
+    QCOMPARE(connected.first().first().toString(), name);
+    QTRY_COMPARE(local.peers(), QStringList{name + "-peer"});
+
+    ExtendedSubscriptionOptions callerThread;
+    callerThread.target = DeliveryTarget::CallerThread;
+    int received = 0;
+    bool ordered = true;
+    remoteBus.subscribe("sensor/**", "observer", [&](const Event& e) {
+        ordered = ordered && e.data["seq"].toInt() == received && e.senderId == "probe"
+            && e.topic == QString("sensor/%1").arg(received % 8) && e.timestamp > 0;
+        received++;
+    }, callerThread);
+    int localCount = 0;
+    m_bus->subscribe("sensor/**", "observer", [&localCount](const Event&) { localCount++; }, callerThread);
+
+    const int events = 20000;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < events; ++i) {
+        m_bus->publish(QString("sensor/%1").arg(i % 8), {{"seq", i}, {"value", i * 0.5}}, "probe");
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(received, events, 10000);
+    qDebug() << "Bridge:" << qRound(events * 1000.0 / qMax<qint64>(1, timer.elapsed())) << "events/s";
+
+    QVERIFY(ordered);
+    QTest::qWait(50);
+    QCOMPARE(localCount, events);           // Nothing echoed back
+    QCOMPARE(local.stats()["sent"].toLongLong(), events);
+    QCOMPARE(local.stats()["dropped"].toLongLong(), 0);
+    QVERIFY(local.stats()["frames"].toLongLong() < events / 10);
+    QCOMPARE(remote.stats()["received"].toLongLong(), events);
+
+    // Values CBOR cannot encode arrive as undefined, and are counted
+    local.forward("raw/**");
+    QVariant raw;
+    remoteBus.subscribe("raw/**", "observer", [&raw](const Event& e) { raw = e.data.value("pointer"); },
+                        callerThread);
+    m_bus->publish("raw/frame", {{"pointer", QVariant::fromValue(static_cast<void*>(&raw))}}, "probe");
+    QTRY_COMPARE(remote.stats()["received"].toLongLong(), events + 1);
+    QCOMPARE(local.stats()["unencodable"].toLongLong(), 1);
+    QVERIFY(!raw.isValid() || raw.isNull());
+
+    // Without peers a batch is dropped and counted
+    EventBusBridge lonely(m_bus, name + "-lonely");
+    QVERIFY(!lonely.setRingCapacity(qsizetype(1) << 31));
+    QVERIFY(lonely.setRingCapacity(1 << 20));
+    lonely.forward("lonely/**");
+    for (int i = 0; i < 3; ++i) {
+        m_bus->publish("lonely/tick", {{"i", i}}, "probe");
+    }
+    QTRY_COMPARE(lonely.stats()["dropped"].toLongLong(), 3);
+}
+
 // =============================================================================
 // Edge cases
 // =============================================================================
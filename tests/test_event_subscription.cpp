@@ -0,0 +1,379 @@
+#include <QTest>
+#include <QCoreApplication>
+#include <QQuickWindow>
+#include <QSignalSpy>
+
+#include "event_bus_service.h"
+#include "event_subscription.h"
+
+#include <memory>
+
+using namespace mpf;
+
+class TestEventSubscription : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    // Subscription lifecycle
+    void testSubscribesOnComplete();
+    void testPatternChangeResubscribes();
+    void testEnabled();
+    void testNoBus();
+
+    // Delivery
+    void testDelivery();
+    void testFilterAndOwnEvents();
+
+    // PerFrame delivery
+    void testPerFrameCoalesces();
+    void testPerFrameWithoutWindow();
+    void testPerFrameWithWindow();
+    void testPerFrameCap();
+    void testDeliverySwitchFlushes();
+
+    // Teardown
+    void testDestroyUnsubscribes();
+    void testDestroyWithQueuedEvents();
+    void testBusDestroyedFirst();
+    void testDestroyWhileFramePending();
+
+private:
+    std::unique_ptr<EventSubscription> makeSubscription(const QString& pattern,
+                                                        const QString& subscriberId = "qml");
+
+    EventBusService* m_bus = nullptr;
+};
+
+void TestEventSubscription::init()
+{
+    m_bus = new EventBusService(this);
+    EventSubscription::setBus(m_bus);
+}
+
+void TestEventSubscription::cleanup()
+{
+    EventSubscription::setBus(nullptr);
+    delete m_bus;
+    m_bus = nullptr;
+}
+
+// Same order as the QML engine: properties first, then componentComplete()
+std::unique_ptr<EventSubscription> TestEventSubscription::makeSubscription(const QString& pattern,
+                                                                           const QString& subscriberId)
+{
+    auto subscription = std::make_unique<EventSubscription>();
+    subscription->classBegin();
+    subscription->setPattern(pattern);
+    subscription->setSubscriberId(subscriberId);
+    subscription->componentComplete();
+    return subscription;
+}
+
+// =============================================================================
+// Subscription lifecycle
+// =============================================================================
+
+void TestEventSubscription::testSubscribesOnComplete()
+{
+    EventSubscription subscription;
+    QSignalSpy active(&subscription, &EventSubscription::activeChanged);
+    subscription.classBegin();
+    subscription.setPattern("orders/*");
+    subscription.setSubscriberId("qml");
+
+    // Bindings are still being applied: nothing subscribed yet
+    QVERIFY(!subscription.isActive());
+    QCOMPARE(m_bus->totalSubscribers(), 0);
+
+    subscription.componentComplete();
+    QVERIFY(subscription.isActive());
+    QCOMPARE(active.count(), 1);
+    QCOMPARE(m_bus->totalSubscribers(), 1);
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 1);
+}
+
+void TestEventSubscription::testPatternChangeResubscribes()
+{
+    auto subscription = makeSubscription("orders/*");
+    QSignalSpy active(subscription.get(), &EventSubscription::activeChanged);
+    QSignalSpy received(subscription.get(), &EventSubscription::received);
+
+    subscription->setPattern("invoices/*");
+    QVERIFY(subscription->isActive());
+    QCOMPARE(active.count(), 0);            // Stayed active throughout
+    QCOMPARE(m_bus->totalSubscribers(), 1);
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 0);
+    QCOMPARE(m_bus->subscriberCount("invoices/created"), 1);
+
+    m_bus->publish("orders/created", {}, "sender");
+    m_bus->publish("invoices/created", {}, "sender");
+    QCoreApplication::processEvents();
+    QCOMPARE(received.count(), 1);
+    QCOMPARE(received.first().at(0).toString(), QString("invoices/created"));
+
+    // Same pattern again is not a resubscription
+    subscription->setPattern("invoices/*");
+    QCOMPARE(m_bus->totalSubscribers(), 1);
+
+    subscription->setPattern(QString());
+    QVERIFY(!subscription->isActive());
+    QCOMPARE(active.count(), 1);
+    QCOMPARE(m_bus->totalSubscribers(), 0);
+}
+
+void TestEventSubscription::testEnabled()
+{
+    auto subscription = makeSubscription("orders/*");
+    QSignalSpy active(subscription.get(), &EventSubscription::activeChanged);
+
+    subscription->setEnabled(false);
+    QVERIFY(!subscription->isActive());
+    QCOMPARE(m_bus->totalSubscribers(), 0);
+
+    // Property changes while disabled don't subscribe
+    subscription->setPattern("invoices/*");
+    QCOMPARE(m_bus->totalSubscribers(), 0);
+
+    subscription->setEnabled(true);
+    QVERIFY(subscription->isActive());
+    QCOMPARE(m_bus->subscriberCount("invoices/created"), 1);
+    QCOMPARE(active.count(), 2);
+}
+
+void TestEventSubscription::testNoBus()
+{
+    EventSubscription::setBus(nullptr);
+    QTest::ignoreMessage(QtWarningMsg, "EventBus: EventSubscription for \"orders/*\" has no bus");
+    auto subscription = makeSubscription("orders/*");
+    QVERIFY(!subscription->isActive());
+}
+
+// =============================================================================
+// Delivery
+// =============================================================================
+
+void TestEventSubscription::testDelivery()
+{
+    auto subscription = makeSubscription("orders/**");
+    QSignalSpy received(subscription.get(), &EventSubscription::received);
+
+    m_bus->publish("orders/created", {{"id", 1}}, "shop");
+    m_bus->publish("customers/created", {{"id", 2}}, "shop");
+    QCOMPARE(received.count(), 0);          // Queued for the owner thread
+
+    // publishSync delivers behind the queued event, before returning
+    m_bus->publishSync("orders/eu/shipped", {{"id", 3}}, "warehouse");
+    QCOMPARE(received.count(), 2);
+    QCOMPARE(received.at(0).at(0).toString(), QString("orders/created"));
+    QCOMPARE(received.at(0).at(2).toString(), QString("shop"));
+    QCOMPARE(received.at(1).at(0).toString(), QString("orders/eu/shipped"));
+    QCOMPARE(received.at(1).at(1).toMap()["id"].toInt(), 3);
+    QCOMPARE(received.at(1).at(2).toString(), QString("warehouse"));
+
+    QCoreApplication::processEvents();
+    QCOMPARE(received.count(), 2);
+}
+
+void TestEventSubscription::testFilterAndOwnEvents()
+{
+    auto subscription = makeSubscription("orders/*");
+    QSignalSpy received(subscription.get(), &EventSubscription::received);
+
+    subscription->setFilter({{"region", QVariantList{"eu", "us"}}});
+    QCOMPARE(m_bus->totalSubscribers(), 1);
+
+    m_bus->publishSync("orders/created", {{"region", "eu"}}, "shop");
+    m_bus->publishSync("orders/created", {{"region", "apac"}}, "shop");
+    m_bus->publishSync("orders/created", {{"region", "us"}}, "qml");   // Own event
+    QCOMPARE(received.count(), 1);
+
+    subscription->setReceiveOwnEvents(true);
+    m_bus->publishSync("orders/created", {{"region", "us"}}, "qml");
+    QCOMPARE(received.count(), 2);
+}
+
+// =============================================================================
+// PerFrame delivery
+// =============================================================================
+
+void TestEventSubscription::testPerFrameCoalesces()
+{
+    auto subscription = makeSubscription("telemetry/**");
+    subscription->setDelivery(EventSubscription::PerFrame);
+    QSignalSpy received(subscription.get(), &EventSubscription::received);
+    QSignalSpy batches(subscription.get(), &EventSubscription::receivedBatch);
+
+    for (int i = 0; i < 5; ++i) {
+        m_bus->publishSync(QString("telemetry/%1").arg(i % 2), {{"i", i}}, "sensor");
+    }
+    QCOMPARE(batches.count(), 0);           // Buffered until the frame
+
+    subscription->flushFrame();
+    QCOMPARE(received.count(), 0);
+    QCOMPARE(batches.count(), 1);
+    const QVariantList events = batches.first().first().toList();
+    QCOMPARE(events.size(), 5);
+    for (int i = 0; i < 5; ++i) {
+        const QVariantMap entry = events.at(i).toMap();
+        QCOMPARE(entry["topic"].toString(), QString("telemetry/%1").arg(i % 2));
+        QCOMPARE(entry["data"].toMap()["i"].toInt(), i);
+        QCOMPARE(entry["senderId"].toString(), QString("sensor"));
+        QVERIFY(entry["timestamp"].toLongLong() > 0);
+    }
+
+    // Nothing buffered, nothing emitted
+    subscription->flushFrame();
+    QCOMPARE(batches.count(), 1);
+}
+
+void TestEventSubscription::testPerFrameWithoutWindow()
+{
+    auto subscription = makeSubscription("telemetry/**");
+    subscription->setDelivery(EventSubscription::PerFrame);
+    QSignalSpy batches(subscription.get(), &EventSubscription::receivedBatch);
+
+    // No window is rendering: the frame clock's fallback timer flushes
+    m_bus->publishSync("telemetry/a", {}, "sensor");
+    m_bus->publishSync("telemetry/b", {}, "sensor");
+    QTRY_COMPARE(batches.count(), 1);
+    QCOMPARE(batches.first().first().toList().size(), 2);
+
+    m_bus->publishSync("telemetry/c", {}, "sensor");
+    QTRY_COMPARE(batches.count(), 2);
+    QCOMPARE(batches.last().first().toList().size(), 1);
+}
+
+void TestEventSubscription::testPerFrameWithWindow()
+{
+    // Exposed, but whether it ever swaps a frame is up to the render loop:
+    // the bounded wait delivers either way
+    QQuickWindow window;
+    window.resize(64, 64);
+    window.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&window));
+
+    auto subscription = makeSubscription("telemetry/**");
+    subscription->setDelivery(EventSubscription::PerFrame);
+    QSignalSpy batches(subscription.get(), &EventSubscription::receivedBatch);
+
+    // Events buffered by a batch handler wait for the next tick, not forever
+    int republished = 0;
+    connect(subscription.get(), &EventSubscription::receivedBatch, this, [&](const QVariantList&) {
+        if (republished < 3) {
+            m_bus->publishSync("telemetry/next", {{"n", ++republished}}, "sensor");
+        }
+    });
+
+    m_bus->publishSync("telemetry/a", {}, "sensor");
+    QTRY_COMPARE_WITH_TIMEOUT(batches.count(), 4, 2000);
+    QCOMPARE(batches.last().first().toList().first().toMap()["data"].toMap()["n"].toInt(), 3);
+}
+
+void TestEventSubscription::testPerFrameCap()
+{
+    auto subscription = makeSubscription("telemetry/**");
+    subscription->setDelivery(EventSubscription::PerFrame);
+    QSignalSpy batches(subscription.get(), &EventSubscription::receivedBatch);
+
+    // More than kMaxFrameEvents (10000) before a frame: the oldest are dropped
+    for (int i = 0; i < 10005; ++i) {
+        m_bus->publishSync("telemetry/a", {{"i", i}}, "sensor");
+    }
+    subscription->flushFrame();
+
+    QCOMPARE(batches.count(), 1);
+    const QVariantList events = batches.first().first().toList();
+    QCOMPARE(events.size(), 10000);
+    QCOMPARE(events.first().toMap()["data"].toMap()["i"].toInt(), 5);
+    QCOMPARE(events.last().toMap()["data"].toMap()["i"].toInt(), 10004);
+}
+
+void TestEventSubscription::testDeliverySwitchFlushes()
+{
+    auto subscription = makeSubscription("telemetry/**");
+    subscription->setDelivery(EventSubscription::PerFrame);
+    QSignalSpy received(subscription.get(), &EventSubscription::received);
+    QSignalSpy batches(subscription.get(), &EventSubscription::receivedBatch);
+
+    m_bus->publishSync("telemetry/a", {{"i", 0}}, "sensor");
+    m_bus->publishSync("telemetry/a", {{"i", 1}}, "sensor");
+
+    // Buffered events are handed over before switching, in their order
+    QStringList order;
+    connect(subscription.get(), &EventSubscription::receivedBatch, this,
+            [&order](const QVariantList& events) { order.append(QString("batch:%1").arg(events.size())); });
+    connect(subscription.get(), &EventSubscription::deliveryChanged, this,
+            [&order]() { order.append("deliveryChanged"); });
+    subscription->setDelivery(EventSubscription::PerEvent);
+    QCOMPARE(order, QStringList({"batch:2", "deliveryChanged"}));
+
+    m_bus->publishSync("telemetry/a", {{"i", 2}}, "sensor");
+    QCOMPARE(received.count(), 1);
+    QCOMPARE(received.first().at(1).toMap()["i"].toInt(), 2);
+
+    // The pending frame finds nothing left to flush
+    QTest::qWait(50);
+    QCOMPARE(batches.count(), 1);
+}
+
+// =============================================================================
+// Teardown
+// =============================================================================
+
+void TestEventSubscription::testDestroyUnsubscribes()
+{
+    auto subscription = makeSubscription("orders/*");
+    QCOMPARE(m_bus->totalSubscribers(), 1);
+
+    subscription.reset();
+    QCOMPARE(m_bus->totalSubscribers(), 0);
+    QCOMPARE(m_bus->subscriberCount("orders/created"), 0);
+}
+
+void TestEventSubscription::testDestroyWithQueuedEvents()
+{
+    auto subscription = makeSubscription("orders/*");
+    QSignalSpy received(subscription.get(), &EventSubscription::received);
+
+    // Queued for the owner thread, then the element goes away before delivery
+    QCOMPARE(m_bus->publish("orders/created", {}, "shop"), 1);
+    QCOMPARE(m_bus->publish("orders/updated", {}, "shop"), 1);
+    subscription.reset();
+
+    QCoreApplication::processEvents();
+    QCOMPARE(received.count(), 0);
+}
+
+void TestEventSubscription::testBusDestroyedFirst()
+{
+    auto subscription = makeSubscription("orders/*");
+    QVERIFY(subscription->isActive());
+
+    delete m_bus;
+    m_bus = nullptr;
+    subscription.reset();                   // Must not touch the deleted bus
+}
+
+void TestEventSubscription::testDestroyWhileFramePending()
+{
+    auto subscription = makeSubscription("telemetry/**");
+    subscription->setDelivery(EventSubscription::PerFrame);
+    m_bus->publishSync("telemetry/a", {}, "sensor");
+
+    // The frame clock still has it waiting; the tick must skip it
+    subscription.reset();
+    QTest::qWait(50);
+
+    auto next = makeSubscription("telemetry/**");
+    next->setDelivery(EventSubscription::PerFrame);
+    QSignalSpy batches(next.get(), &EventSubscription::receivedBatch);
+    m_bus->publishSync("telemetry/b", {}, "sensor");
+    QTRY_COMPARE(batches.count(), 1);
+}
+
+QTEST_MAIN(TestEventSubscription)
+#include "test_event_subscription.moc"